@@ -0,0 +1,80 @@
+#include "allocationcounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+#ifndef NDEBUG
+
+namespace
+{
+    atomic<size_t> s_allocations(0);
+
+    void *allocate(size_t size)
+    {
+        s_allocations.fetch_add(1, memory_order_relaxed);
+
+        void *ptr = malloc(size == 0 ? 1 : size);
+        if (!ptr)
+            throw bad_alloc();
+        return ptr;
+    }
+}
+
+// The array and nothrow forms of new, and all forms of delete, forward to
+// these by default.
+void *operator new(size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+bool AllocationCounter::enabled()
+{
+    return true;
+}
+
+size_t AllocationCounter::count()
+{
+    return s_allocations.load(memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::enabled()
+{
+    return false;
+}
+
+size_t AllocationCounter::count()
+{
+    return 0;
+}
+
+#endif
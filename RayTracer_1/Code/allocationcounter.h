@@ -0,0 +1,19 @@
+#ifndef ALLOCATIONCOUNTER_H_
+#define ALLOCATIONCOUNTER_H_
+
+#include <cstddef>
+
+// Counts the heap allocations of the program. In debug builds (without
+// NDEBUG) the global operator new is replaced by one which counts its calls,
+// so the allocations made while tracing can be reported. In release builds
+// nothing is replaced and count() is always 0.
+namespace AllocationCounter
+{
+    // true if allocations are counted in this build
+    bool enabled();
+
+    // number of calls to operator new so far
+    std::size_t count();
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "benchmark.h"
+
+#include "image.h"
+
+#include "json/json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    // Silences cout while it exists: readScene and renderToFile report
+    // their progress, which is not wanted for every run.
+    class QuietCout
+    {
+        streambuf *d_buffer;
+
+        public:
+            QuietCout()
+            :
+                d_buffer(cout.rdbuf(nullptr))
+            {}
+
+            ~QuietCout()
+            {
+                cout.rdbuf(d_buffer);
+            }
+    };
+
+    // Scenes/2_reflection/1.json -> 2_reflection_1
+    string sceneName(string const &sceneFile)
+    {
+        string name = sceneFile.substr(0, sceneFile.find_last_of('.'));
+        size_t file = name.find_last_of('/');
+        if (file == string::npos)
+            return name;
+
+        size_t dir = name.find_last_of('/', file - 1);
+        dir = dir == string::npos ? 0 : dir + 1;
+        return name.substr(dir, file - dir) + '_' + name.substr(file + 1);
+    }
+
+    double raysPerSecond(unsigned long rays, double seconds)
+    {
+        return seconds > 0 ? rays / seconds : 0;
+    }
+}
+
+Benchmark::Benchmark(unsigned runs, double minPSNR)
+:
+    d_runs(max(runs, 1U)),
+    d_minPSNR(minPSNR),
+    d_results()
+{}
+
+bool Benchmark::run(string const &sceneFile)
+{
+    Result result;
+    result.scene = sceneFile;
+    string image = sceneName(sceneFile) + ".png";
+
+    double const inf = numeric_limits<double>::infinity();
+    Raytracer::Timings &best = result.timings;
+    best.parse = best.build = best.trace = best.encode = inf;
+
+    for (unsigned run = 0; run != d_runs; ++run)
+    {
+        Raytracer raytracer;
+        {
+            QuietCout quiet;
+            if (!raytracer.readScene(sceneFile))
+                return false;
+
+            raytracer.renderToFile(image);
+        }
+
+        Raytracer::Timings const &timings = raytracer.getTimings();
+        best.parse = min(best.parse, timings.parse);
+        best.build = min(best.build, timings.build);
+        best.trace = min(best.trace, timings.trace);
+        best.encode = min(best.encode, timings.encode);
+    }
+
+    // one camera ray per pixel
+    Image img(image);
+    result.rays = static_cast<unsigned long>(img.width()) * img.height();
+
+    string reference = sceneFile.substr(0, sceneFile.find_last_of('.')) + ".png";
+    result.hasReference = ifstream(reference).good();
+    result.psnr = result.hasReference ? psnr(image, reference) : inf;
+    result.passed = !result.hasReference || result.psnr >= d_minPSNR;
+
+    d_results.push_back(result);
+    return true;
+}
+
+bool Benchmark::passed() const
+{
+    return all_of(d_results.begin(), d_results.end(),
+                  [](Result const &result) { return result.passed; });
+}
+
+void Benchmark::report(ostream &out) const
+{
+    out << "Best of " << d_runs << " run(s), times in ms:\n\n"
+        << left << setw(28) << "Scene" << right
+        << setw(8) << "parse" << setw(8) << "build" << setw(9) << "trace"
+        << setw(8) << "encode" << setw(10) << "primary" << setw(9) << "Mrays/s"
+        << setw(8) << "PSNR"
+        << '\n';
+
+    for (Result const &result : d_results)
+    {
+        Raytracer::Timings const &timings = result.timings;
+
+        out << left << setw(28) << sceneName(result.scene) << right
+            << fixed << setprecision(1)
+            << setw(8) << timings.parse * 1E3 << setw(8) << timings.build * 1E3
+            << setw(9) << timings.trace * 1E3 << setw(8) << timings.encode * 1E3
+            << setw(10) << result.rays << setprecision(2)
+            << setw(9) << raysPerSecond(result.rays, timings.trace) / 1E6;
+
+        if (!result.hasReference)
+            out << setw(8) << '-';
+        else
+            out << setprecision(1) << setw(8) << result.psnr;
+
+        if (!result.passed)
+            out << "  below " << d_minPSNR << " dB";
+        out << '\n';
+    }
+}
+
+void Benchmark::writeJSON(string const &filename) const
+{
+    json results = json::array();
+    for (Result const &result : d_results)
+    {
+        Raytracer::Timings const &timings = result.timings;
+        unsigned long rays = result.rays;
+
+        json entry;
+        entry["scene"] = result.scene;
+        entry["runs"] = d_runs;
+        entry["seconds"] = {
+            {"parse", timings.parse},
+            {"build", timings.build},
+            {"trace", timings.trace},
+            {"encode", timings.encode}
+        };
+        entry["rays"] = {
+            {"primary", rays}
+        };
+        entry["rays_per_second"] = {
+            {"primary", raysPerSecond(rays, timings.trace)},
+            {"total", raysPerSecond(rays, timings.trace)}
+        };
+
+        // JSON has no infinity: identical images have a PSNR of null
+        if (result.hasReference)
+            entry["psnr"] = isinf(result.psnr) ? json() : json(result.psnr);
+        entry["passed"] = result.passed;
+
+        results.push_back(entry);
+    }
+
+    ofstream out(filename);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing.");
+    out << setw(4) << results << '\n';
+}
+
+void Benchmark::writeCSV(string const &filename) const
+{
+    ofstream out(filename);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing.");
+
+    out << "scene,runs,parse_s,build_s,trace_s,encode_s,"
+           "primary_rays,rays_per_s,psnr_db,passed\n";
+    out << setprecision(9);
+    for (Result const &result : d_results)
+    {
+        Raytracer::Timings const &timings = result.timings;
+        out << result.scene << ',' << d_runs << ','
+            << timings.parse << ',' << timings.build << ','
+            << timings.trace << ',' << timings.encode << ','
+            << result.rays << ','
+            << raysPerSecond(result.rays, timings.trace) << ',';
+        if (result.hasReference)
+            out << result.psnr;
+        out << ',' << (result.passed ? "yes" : "no") << '\n';
+    }
+}
+
+// --- Private -----------------------------------------------------------------
+
+double Benchmark::psnr(string const &image, string const &reference)
+{
+    Image img(image);
+    Image ref(reference);
+    if (img.width() != ref.width() || img.height() != ref.height())
+        return 0;
+
+    // Both images come from 8 bit PNG files, so the error is on that scale.
+    double error = 0;
+    for (unsigned y = 0; y != img.height(); ++y)
+        for (unsigned x = 0; x != img.width(); ++x)
+        {
+            Color diff = img(x, y) - ref(x, y);
+            error += diff.dot(diff);
+        }
+
+    if (error == 0)
+        return numeric_limits<double>::infinity();
+
+    double mse = error / (3.0 * img.width() * img.height());
+    return 10 * log10(1 / mse);
+}
@@ -0,0 +1,57 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "raytracer.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Renders scenes a number of times and records the duration of every stage
+// (the fastest of the runs), the number of rays traced and the PSNR of the
+// image against the reference image next to the scene file (the scene file
+// with .png instead of .json), if there is one. The results have the
+// layout of those of the RayTracer_2 benchmark, without the shadow and
+// secondary rays: only camera rays are traced here.
+//
+// The images are written to the working directory, named after the scene
+// file and its directory (Scenes/2_reflection/1.json: 2_reflection_1.png).
+class Benchmark
+{
+    public:
+        struct Result
+        {
+            std::string scene;
+            Raytracer::Timings timings;
+            unsigned long rays;     // camera rays
+            bool hasReference;
+            double psnr;        // in dB, infinite if identical
+            bool passed;        // no reference, or psnr >= the threshold
+        };
+
+    private:
+        unsigned d_runs;
+        double d_minPSNR;
+        std::vector<Result> d_results;
+
+    public:
+        Benchmark(unsigned runs, double minPSNR);
+
+        // Benchmark a scene, false if it could not be read
+        bool run(std::string const &sceneFile);
+
+        // true if all scenes rendered within the PSNR threshold
+        bool passed() const;
+
+        // a table of the results
+        void report(std::ostream &out) const;
+
+        void writeJSON(std::string const &filename) const;
+        void writeCSV(std::string const &filename) const;
+
+    private:
+        // PSNR of two images of the same size, infinite if identical
+        static double psnr(std::string const &image, std::string const &reference);
+};
+
+#endif
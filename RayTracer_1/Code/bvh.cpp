@@ -0,0 +1,186 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+using namespace std;
+
+namespace
+{
+    unsigned const NUM_BINS = 12;
+
+    // Beyond this depth nodes are split at the median, which bounds the
+    // depth of the tree (and thereby the traversal stack) to 32 + log2(n).
+    unsigned const MAX_SAH_DEPTH = 32;
+
+    struct Bin
+    {
+        AABB box;
+        unsigned count = 0;
+    };
+}
+
+void BVH::build(vector<AABB> const &boxes)
+{
+    clear();
+    if (boxes.empty())
+        return;
+
+    vector<Point> centroids;
+    centroids.reserve(boxes.size());
+    for (AABB const &box : boxes)
+        centroids.push_back(box.center());
+
+    d_indices.resize(boxes.size());
+    iota(d_indices.begin(), d_indices.end(), 0U);
+
+    // a binary tree with n leaves has 2n - 1 nodes
+    d_nodes.reserve(2 * boxes.size() - 1);
+    buildNode(boxes, centroids, 0, boxes.size(), 0);
+}
+
+void BVH::assign(vector<Node> nodes, vector<unsigned> order)
+{
+    d_nodes = move(nodes);
+    d_indices = move(order);
+}
+
+void BVH::clear()
+{
+    d_nodes.clear();
+    d_indices.clear();
+}
+
+bool BVH::empty() const
+{
+    return d_nodes.empty();
+}
+
+unsigned BVH::numNodes() const
+{
+    return d_nodes.size();
+}
+
+vector<unsigned> const &BVH::order() const
+{
+    return d_indices;
+}
+
+vector<BVH::Node> const &BVH::nodes() const
+{
+    return d_nodes;
+}
+
+unsigned BVH::buildNode(vector<AABB> const &boxes,
+                        vector<Point> const &centroids,
+                        unsigned begin, unsigned end, unsigned depth)
+{
+    unsigned nodeIdx = d_nodes.size();
+    d_nodes.push_back(Node());
+
+    AABB bounds;
+    AABB centroidBounds;
+    for (unsigned idx = begin; idx != end; ++idx)
+    {
+        bounds.extend(boxes[d_indices[idx]]);
+        centroidBounds.extend(centroids[d_indices[idx]]);
+    }
+    d_nodes[nodeIdx].box = bounds;
+
+    unsigned count = end - begin;
+    if (count <= MAX_LEAF_SIZE)
+    {
+        d_nodes[nodeIdx].offset = begin;
+        d_nodes[nodeIdx].count = count;
+        return nodeIdx;
+    }
+
+    // Split along the axis with the largest centroid extent.
+    Vector extent = centroidBounds.max - centroidBounds.min;
+    unsigned axis = 0;
+    if (extent.y > extent.data[axis])
+        axis = 1;
+    if (extent.z > extent.data[axis])
+        axis = 2;
+
+    auto first = d_indices.begin() + begin;
+    auto last = d_indices.begin() + end;
+    unsigned mid;
+
+    if (depth < MAX_SAH_DEPTH && extent.data[axis] > 0.0)
+    {
+        // Bin the centroids and evaluate the SAH at each bin boundary.
+        // The first and last bin are never empty, so a split always exists.
+        double minC = centroidBounds.min.data[axis];
+        double scale = NUM_BINS / extent.data[axis];
+        auto binOf = [&](unsigned prim)
+        {
+            unsigned bin = static_cast<unsigned>(
+                (centroids[prim].data[axis] - minC) * scale);
+            return min(bin, NUM_BINS - 1);
+        };
+
+        Bin bins[NUM_BINS];
+        for (unsigned idx = begin; idx != end; ++idx)
+        {
+            Bin &bin = bins[binOf(d_indices[idx])];
+            bin.box.extend(boxes[d_indices[idx]]);
+            ++bin.count;
+        }
+
+        // sweep from the right to get the area and count right of each split
+        double rightArea[NUM_BINS];
+        unsigned rightCount[NUM_BINS];
+        AABB rightBox;
+        unsigned rightSum = 0;
+        for (unsigned split = NUM_BINS - 1; split != 0; --split)
+        {
+            rightBox.extend(bins[split].box);
+            rightSum += bins[split].count;
+            rightArea[split] = rightBox.surfaceArea();
+            rightCount[split] = rightSum;
+        }
+
+        double bestCost = numeric_limits<double>::infinity();
+        unsigned bestSplit = 1;
+        AABB leftBox;
+        unsigned leftSum = 0;
+        for (unsigned split = 1; split != NUM_BINS; ++split)
+        {
+            leftBox.extend(bins[split - 1].box);
+            leftSum += bins[split - 1].count;
+            if (leftSum == 0 || rightCount[split] == 0)
+                continue;
+
+            double cost = leftBox.surfaceArea() * leftSum
+                        + rightArea[split] * rightCount[split];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = split;
+            }
+        }
+
+        mid = partition(first, last, [&](unsigned prim)
+        {
+            return binOf(prim) < bestSplit;
+        }) - d_indices.begin();
+    }
+    else
+    {
+        // median split, also used when all centroids coincide
+        mid = begin + count / 2;
+        nth_element(first, d_indices.begin() + mid, last,
+            [&](unsigned lhs, unsigned rhs)
+            {
+                return centroids[lhs].data[axis] < centroids[rhs].data[axis];
+            });
+    }
+
+    buildNode(boxes, centroids, begin, mid, depth + 1);
+    d_nodes[nodeIdx].offset = buildNode(boxes, centroids, mid, end, depth + 1);
+    d_nodes[nodeIdx].count = 0;
+    return nodeIdx;
+}
@@ -0,0 +1,139 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include "aabb.h"
+#include "ray.h"
+
+#include <vector>
+
+// Bounding volume hierarchy over a set of primitives which are only known
+// by their bounding boxes. The tree is built with a binned surface area
+// heuristic and stored flattened in depth-first order: the left child of an
+// interior node directly follows it, the index of the right child is stored.
+//
+// Leaves refer to contiguous ranges of primitives in BVH order: after
+// build(), the user should store its primitives in the order given by
+// order(), so leaf ranges index the primitives directly.
+class BVH
+{
+    public:
+        // leaves hold at most this many primitives
+        static unsigned const MAX_LEAF_SIZE = 4;
+
+        struct Node
+        {
+            AABB box;
+            unsigned offset;    // leaf: first entry in d_indices
+                                // interior: index of the right child
+            unsigned count;     // number of primitives, 0 for interior nodes
+        };
+
+    private:
+        std::vector<Node> d_nodes;
+        std::vector<unsigned> d_indices;
+
+    public:
+        void build(std::vector<AABB> const &boxes);
+
+        // restore a tree from the nodes() and order() of a built one
+        void assign(std::vector<Node> nodes, std::vector<unsigned> order);
+        void clear();
+
+        bool empty() const;
+        unsigned numNodes() const;
+
+        // order()[i] is the index (in the vector passed to build()) of the
+        // primitive which should be stored at position i
+        std::vector<unsigned> const &order() const;
+
+        std::vector<Node> const &nodes() const;
+
+        // Visit all leaves whose bounding box is entered by the ray before
+        // tMax, closest nodes first. The visitor is called as
+        // visit(first, count, tMax) for the range of primitives in the leaf
+        // and may shrink tMax to cull further nodes.
+        // Returning true from the visitor ends the traversal.
+        template <typename Visitor>
+        void traverse(Ray const &ray, double &tMax, Visitor &&visit) const;
+
+    private:
+        unsigned buildNode(std::vector<AABB> const &boxes,
+                           std::vector<Point> const &centroids,
+                           unsigned begin, unsigned end, unsigned depth);
+};
+
+template <typename Visitor>
+void BVH::traverse(Ray const &ray, double &tMax, Visitor &&visit) const
+{
+    if (d_nodes.empty())
+        return;
+
+    Vector invD(1.0 / ray.D.x, 1.0 / ray.D.y, 1.0 / ray.D.z);
+
+    double tEntry;
+    if (!d_nodes[0].box.intersect(ray.O, invD, tMax, tEntry))
+        return;
+
+    // Stack of nodes still to be visited, with their entry distances.
+    // The tree depth is bounded by the build, 64 is plenty.
+    unsigned stack[64];
+    double entry[64];
+    unsigned top = 0;
+
+    unsigned current = 0;
+    while (true)
+    {
+        Node const &node = d_nodes[current];
+        if (node.count > 0)
+        {
+            if (visit(node.offset, node.count, tMax))
+                return;
+        }
+        else
+        {
+            unsigned left = current + 1;
+            unsigned right = node.offset;
+            double tLeft;
+            double tRight;
+            bool hitLeft = d_nodes[left].box.intersect(ray.O, invD, tMax, tLeft);
+            bool hitRight = d_nodes[right].box.intersect(ray.O, invD, tMax, tRight);
+
+            if (hitLeft && hitRight)
+            {
+                // descend into the closest child, postpone the other
+                if (tRight < tLeft)
+                {
+                    std::swap(left, right);
+                    std::swap(tLeft, tRight);
+                }
+                stack[top] = right;
+                entry[top] = tRight;
+                ++top;
+                current = left;
+                continue;
+            }
+            if (hitLeft)
+            {
+                current = left;
+                continue;
+            }
+            if (hitRight)
+            {
+                current = right;
+                continue;
+            }
+        }
+
+        // pop the next node which can still contain a closer hit
+        do
+        {
+            if (top == 0)
+                return;
+            --top;
+        }
+        while (entry[top] > tMax);
+        current = stack[top];
+    }
+}
+
+#endif
@@ -0,0 +1,357 @@
+#include "kernels.h"
+
+#include "shapes/triangle.h"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    double const NaN = numeric_limits<double>::quiet_NaN();
+    double const EPSILON = 0.0000001;   // as in Triangle::mollerTrumbore
+
+// --- Scalar kernels ----------------------------------------------------------
+
+    // As Sphere::intersect, without the normal
+    double sphereDistance(Point const &O, Vector const &D,
+                          Point const &center, double r)
+    {
+        Vector OC = O - center;
+        double a = D.dot(D);
+        double b = 2.0 * OC.dot(D);
+        double c = OC.dot(OC) - r*r;
+        double d = b*b - 4*a*c;
+
+        if (d < 0.0)
+            return NaN;
+
+        double numerator = -b - sqrt(d);
+        if (numerator > 0.0)
+            return numerator / (2.0 * a);
+
+        numerator = -b + sqrt(d);
+        if (numerator > 0.0)
+            return numerator / (2.0 * a);
+
+        return NaN;
+    }
+
+    void intersectSpheresScalar(Ray const &ray, Kernels::SphereBlock const &block,
+                                double t[])
+    {
+        for (unsigned lane = 0; lane != Kernels::BLOCK_SIZE; ++lane)
+            t[lane] = sphereDistance(ray.O, ray.D,
+                Point(block.cx[lane], block.cy[lane], block.cz[lane]),
+                block.r[lane]);
+    }
+
+    void intersectTrianglesScalar(Ray const &ray, Kernels::TriangleBlock const &block,
+                                  double t[])
+    {
+        for (unsigned lane = 0; lane != Kernels::BLOCK_SIZE; ++lane)
+            t[lane] = Triangle::mollerTrumbore(ray,
+                Point(block.v0x[lane], block.v0y[lane], block.v0z[lane]),
+                Vector(block.e1x[lane], block.e1y[lane], block.e1z[lane]),
+                Vector(block.e2x[lane], block.e2y[lane], block.e2z[lane]));
+    }
+
+    void intersectSphereScalar(Kernels::RayPacket const &rays, Point const &center,
+                               double radius, double t[])
+    {
+        for (unsigned lane = 0; lane != Kernels::PACKET_SIZE; ++lane)
+            t[lane] = sphereDistance(
+                Point(rays.ox[lane], rays.oy[lane], rays.oz[lane]),
+                Vector(rays.dx[lane], rays.dy[lane], rays.dz[lane]),
+                center, radius);
+    }
+
+    void intersectTriangleScalar(Kernels::RayPacket const &rays, Point const &v0,
+                                 Vector const &edge1, Vector const &edge2, double t[])
+    {
+        for (unsigned lane = 0; lane != Kernels::PACKET_SIZE; ++lane)
+        {
+            Ray ray(Point(rays.ox[lane], rays.oy[lane], rays.oz[lane]),
+                    Vector(rays.dx[lane], rays.dy[lane], rays.dz[lane]));
+            t[lane] = Triangle::mollerTrumbore(ray, v0, edge1, edge2);
+        }
+    }
+
+// --- AVX2 kernels ------------------------------------------------------------
+
+#ifdef KERNELS_AVX2
+
+    // The kernels below perform the operations of the scalar code in the same
+    // order. They are compiled for AVX2 only (not FMA), so the compiler cannot
+    // contract them into fused multiply-adds, which would round differently.
+
+    struct Vec3
+    {
+        __m256d x;
+        __m256d y;
+        __m256d z;
+    };
+
+    __attribute__((target("avx2")))
+    inline __m256d dot(Vec3 const &lhs, Vec3 const &rhs)
+    {
+        return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(lhs.x, rhs.x),
+                                           _mm256_mul_pd(lhs.y, rhs.y)),
+                             _mm256_mul_pd(lhs.z, rhs.z));
+    }
+
+    __attribute__((target("avx2")))
+    inline Vec3 cross(Vec3 const &lhs, Vec3 const &rhs)
+    {
+        return Vec3{
+            _mm256_sub_pd(_mm256_mul_pd(lhs.y, rhs.z), _mm256_mul_pd(lhs.z, rhs.y)),
+            _mm256_sub_pd(_mm256_mul_pd(lhs.z, rhs.x), _mm256_mul_pd(lhs.x, rhs.z)),
+            _mm256_sub_pd(_mm256_mul_pd(lhs.x, rhs.y), _mm256_mul_pd(lhs.y, rhs.x))};
+    }
+
+    __attribute__((target("avx2")))
+    inline Vec3 sub(Vec3 const &lhs, Vec3 const &rhs)
+    {
+        return Vec3{_mm256_sub_pd(lhs.x, rhs.x),
+                    _mm256_sub_pd(lhs.y, rhs.y),
+                    _mm256_sub_pd(lhs.z, rhs.z)};
+    }
+
+    __attribute__((target("avx2")))
+    inline Vec3 broadcast(Triple const &t)
+    {
+        return Vec3{_mm256_set1_pd(t.x), _mm256_set1_pd(t.y), _mm256_set1_pd(t.z)};
+    }
+
+    __attribute__((target("avx2")))
+    inline Vec3 load(double const *x, double const *y, double const *z)
+    {
+        return Vec3{_mm256_loadu_pd(x), _mm256_loadu_pd(y), _mm256_loadu_pd(z)};
+    }
+
+    __attribute__((target("avx2")))
+    __m256d sphereDistance(Vec3 const &O, Vec3 const &D, Vec3 const &center, __m256d r)
+    {
+        __m256d const zero = _mm256_setzero_pd();
+
+        Vec3 OC = sub(O, center);
+        __m256d a = dot(D, D);
+        __m256d b = _mm256_mul_pd(_mm256_set1_pd(2.0), dot(OC, D));
+        __m256d c = _mm256_sub_pd(dot(OC, OC), _mm256_mul_pd(r, r));
+        __m256d d = _mm256_sub_pd(_mm256_mul_pd(b, b),
+            _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(4.0), a), c));
+
+        __m256d root = _mm256_sqrt_pd(d);
+        __m256d minusB = _mm256_xor_pd(b, _mm256_set1_pd(-0.0));
+        __m256d twoA = _mm256_mul_pd(_mm256_set1_pd(2.0), a);
+        __m256d near = _mm256_sub_pd(minusB, root);
+        __m256d far = _mm256_add_pd(minusB, root);
+
+        // near root if in front, otherwise far root if in front, otherwise NaN
+        __m256d t = _mm256_set1_pd(NaN);
+        t = _mm256_blendv_pd(t, _mm256_div_pd(far, twoA),
+                             _mm256_cmp_pd(far, zero, _CMP_GT_OQ));
+        t = _mm256_blendv_pd(t, _mm256_div_pd(near, twoA),
+                             _mm256_cmp_pd(near, zero, _CMP_GT_OQ));
+        return _mm256_blendv_pd(t, _mm256_set1_pd(NaN),
+                                _mm256_cmp_pd(d, zero, _CMP_LT_OQ));
+    }
+
+    __attribute__((target("avx2")))
+    __m256d mollerTrumbore(Vec3 const &O, Vec3 const &D, Vec3 const &v0,
+                           Vec3 const &edge1, Vec3 const &edge2)
+    {
+        __m256d const zero = _mm256_setzero_pd();
+        __m256d const one = _mm256_set1_pd(1.0);
+        __m256d const eps = _mm256_set1_pd(EPSILON);
+
+        Vec3 h = cross(D, edge2);
+        __m256d a = dot(edge1, h);
+        __m256d miss = _mm256_and_pd(
+            _mm256_cmp_pd(a, _mm256_set1_pd(-EPSILON), _CMP_GT_OQ),
+            _mm256_cmp_pd(a, eps, _CMP_LT_OQ));
+
+        __m256d f = _mm256_div_pd(one, a);
+        Vec3 s = sub(O, v0);
+        __m256d u = _mm256_mul_pd(f, dot(s, h));
+        miss = _mm256_or_pd(miss, _mm256_cmp_pd(u, zero, _CMP_LT_OQ));
+        miss = _mm256_or_pd(miss, _mm256_cmp_pd(u, one, _CMP_GT_OQ));
+
+        Vec3 q = cross(s, edge1);
+        __m256d v = _mm256_mul_pd(f, dot(D, q));
+        miss = _mm256_or_pd(miss, _mm256_cmp_pd(v, zero, _CMP_LT_OQ));
+        miss = _mm256_or_pd(miss,
+            _mm256_cmp_pd(_mm256_add_pd(u, v), one, _CMP_GT_OQ));
+
+        // the scalar code stores t in a float
+        __m256d t = _mm256_cvtps_pd(_mm256_cvtpd_ps(_mm256_mul_pd(f, dot(edge2, q))));
+        miss = _mm256_or_pd(miss, _mm256_cmp_pd(t, eps, _CMP_NGT_UQ));
+
+        return _mm256_blendv_pd(t, _mm256_set1_pd(NaN), miss);
+    }
+
+    __attribute__((target("avx2")))
+    void intersectSpheresAVX2(Ray const &ray, Kernels::SphereBlock const &block,
+                              double t[])
+    {
+        _mm256_storeu_pd(t, sphereDistance(broadcast(ray.O), broadcast(ray.D),
+            load(block.cx, block.cy, block.cz), _mm256_loadu_pd(block.r)));
+    }
+
+    __attribute__((target("avx2")))
+    void intersectTrianglesAVX2(Ray const &ray, Kernels::TriangleBlock const &block,
+                                double t[])
+    {
+        _mm256_storeu_pd(t, mollerTrumbore(broadcast(ray.O), broadcast(ray.D),
+            load(block.v0x, block.v0y, block.v0z),
+            load(block.e1x, block.e1y, block.e1z),
+            load(block.e2x, block.e2y, block.e2z)));
+    }
+
+    __attribute__((target("avx2")))
+    void intersectSphereAVX2(Kernels::RayPacket const &rays, Point const &center,
+                             double radius, double t[])
+    {
+        Vec3 C = broadcast(center);
+        __m256d r = _mm256_set1_pd(radius);
+        for (unsigned lane = 0; lane != Kernels::PACKET_SIZE; lane += 4)
+            _mm256_storeu_pd(t + lane, sphereDistance(
+                load(rays.ox + lane, rays.oy + lane, rays.oz + lane),
+                load(rays.dx + lane, rays.dy + lane, rays.dz + lane), C, r));
+    }
+
+    __attribute__((target("avx2")))
+    void intersectTriangleAVX2(Kernels::RayPacket const &rays, Point const &v0,
+                               Vector const &edge1, Vector const &edge2, double t[])
+    {
+        Vec3 V0 = broadcast(v0);
+        Vec3 E1 = broadcast(edge1);
+        Vec3 E2 = broadcast(edge2);
+        for (unsigned lane = 0; lane != Kernels::PACKET_SIZE; lane += 4)
+            _mm256_storeu_pd(t + lane, mollerTrumbore(
+                load(rays.ox + lane, rays.oy + lane, rays.oz + lane),
+                load(rays.dx + lane, rays.dy + lane, rays.dz + lane), V0, E1, E2));
+    }
+
+#endif
+
+// --- Dispatch ----------------------------------------------------------------
+
+    struct KernelSet
+    {
+        char const *name;
+        void (*spheres)(Ray const &, Kernels::SphereBlock const &, double[]);
+        void (*triangles)(Ray const &, Kernels::TriangleBlock const &, double[]);
+        void (*sphere)(Kernels::RayPacket const &, Point const &, double, double[]);
+        void (*triangle)(Kernels::RayPacket const &, Point const &,
+                         Vector const &, Vector const &, double[]);
+    };
+
+    KernelSet const SCALAR = {"scalar",
+        intersectSpheresScalar, intersectTrianglesScalar,
+        intersectSphereScalar, intersectTriangleScalar};
+
+#ifdef KERNELS_AVX2
+    KernelSet const AVX2 = {"avx2",
+        intersectSpheresAVX2, intersectTrianglesAVX2,
+        intersectSphereAVX2, intersectTriangleAVX2};
+#endif
+
+    KernelSet const *detect()
+    {
+#ifdef KERNELS_AVX2
+        __builtin_cpu_init();   // may run before the constructors that do this
+        if (__builtin_cpu_supports("avx2"))
+            return &AVX2;
+#endif
+        return &SCALAR;
+    }
+
+    KernelSet const *kernels = detect();
+}
+
+namespace Kernels
+{
+    SphereBlock::SphereBlock()
+    {
+        for (unsigned lane = 0; lane != BLOCK_SIZE; ++lane)
+            cx[lane] = cy[lane] = cz[lane] = r[lane] = NaN;
+    }
+
+    void SphereBlock::set(unsigned lane, Point const &center, double radius)
+    {
+        cx[lane] = center.x;
+        cy[lane] = center.y;
+        cz[lane] = center.z;
+        r[lane] = radius;
+    }
+
+    TriangleBlock::TriangleBlock()
+    {
+        for (unsigned lane = 0; lane != BLOCK_SIZE; ++lane)
+            v0x[lane] = v0y[lane] = v0z[lane] = e1x[lane] = e1y[lane]
+                = e1z[lane] = e2x[lane] = e2y[lane] = e2z[lane] = NaN;
+    }
+
+    void TriangleBlock::set(unsigned lane, Point const &v0,
+                            Vector const &edge1, Vector const &edge2)
+    {
+        v0x[lane] = v0.x;
+        v0y[lane] = v0.y;
+        v0z[lane] = v0.z;
+        e1x[lane] = edge1.x;
+        e1y[lane] = edge1.y;
+        e1z[lane] = edge1.z;
+        e2x[lane] = edge2.x;
+        e2y[lane] = edge2.y;
+        e2z[lane] = edge2.z;
+    }
+
+    void RayPacket::set(unsigned lane, Ray const &ray)
+    {
+        ox[lane] = ray.O.x;
+        oy[lane] = ray.O.y;
+        oz[lane] = ray.O.z;
+        dx[lane] = ray.D.x;
+        dy[lane] = ray.D.y;
+        dz[lane] = ray.D.z;
+    }
+
+    void intersectSpheres(Ray const &ray, SphereBlock const &block, double t[])
+    {
+        kernels->spheres(ray, block, t);
+    }
+
+    void intersectTriangles(Ray const &ray, TriangleBlock const &block, double t[])
+    {
+        kernels->triangles(ray, block, t);
+    }
+
+    void intersectSphere(RayPacket const &rays, Point const &center,
+                         double radius, double t[])
+    {
+        kernels->sphere(rays, center, radius, t);
+    }
+
+    void intersectTriangle(RayPacket const &rays, Point const &v0,
+                           Vector const &edge1, Vector const &edge2, double t[])
+    {
+        kernels->triangle(rays, v0, edge1, edge2, t);
+    }
+
+    char const *instructionSet()
+    {
+        return kernels->name;
+    }
+
+    void forceScalar(bool scalar)
+    {
+        kernels = scalar ? &SCALAR : detect();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+#include "ray.h"
+
+// Vectorized intersection kernels. Primitives and rays are packed in
+// structure-of-arrays blocks so one call tests a ray against a block of
+// primitives, or a packet of rays against one primitive.
+//
+// Every kernel has a scalar and an AVX2 implementation. The AVX2 version is
+// selected at run time when the CPU supports it. Both compute exactly what
+// Triangle::mollerTrumbore and Sphere::intersect compute, lane by lane, so
+// the choice does not affect the image. A miss gives NaN.
+namespace Kernels
+{
+    // primitives per block: one AVX2 register of doubles
+    unsigned const BLOCK_SIZE = 4;
+
+    // rays per packet: two AVX2 registers of doubles
+    unsigned const PACKET_SIZE = 8;
+
+    // Unused lanes of a block are NaN, which never hits.
+    struct SphereBlock
+    {
+        double cx[BLOCK_SIZE];
+        double cy[BLOCK_SIZE];
+        double cz[BLOCK_SIZE];
+        double r[BLOCK_SIZE];
+
+        SphereBlock();
+        void set(unsigned lane, Point const &center, double radius);
+    };
+
+    struct TriangleBlock
+    {
+        double v0x[BLOCK_SIZE];
+        double v0y[BLOCK_SIZE];
+        double v0z[BLOCK_SIZE];
+        double e1x[BLOCK_SIZE];     // edge1 = v1 - v0
+        double e1y[BLOCK_SIZE];
+        double e1z[BLOCK_SIZE];
+        double e2x[BLOCK_SIZE];     // edge2 = v2 - v0
+        double e2y[BLOCK_SIZE];
+        double e2z[BLOCK_SIZE];
+
+        TriangleBlock();
+        void set(unsigned lane, Point const &v0,
+                 Vector const &edge1, Vector const &edge2);
+    };
+
+    struct RayPacket
+    {
+        double ox[PACKET_SIZE];
+        double oy[PACKET_SIZE];
+        double oz[PACKET_SIZE];
+        double dx[PACKET_SIZE];
+        double dy[PACKET_SIZE];
+        double dz[PACKET_SIZE];
+
+        void set(unsigned lane, Ray const &ray);
+    };
+
+    // one ray against a block of primitives
+    void intersectSpheres(Ray const &ray, SphereBlock const &block,
+                          double t[BLOCK_SIZE]);
+    void intersectTriangles(Ray const &ray, TriangleBlock const &block,
+                            double t[BLOCK_SIZE]);
+
+    // a packet of rays against one primitive
+    void intersectSphere(RayPacket const &rays, Point const &center,
+                         double radius, double t[PACKET_SIZE]);
+    void intersectTriangle(RayPacket const &rays, Point const &v0,
+                           Vector const &edge1, Vector const &edge2,
+                           double t[PACKET_SIZE]);
+
+    // Name of the instruction set of the kernels in use
+    char const *instructionSet();
+
+    // Select the scalar kernels even if AVX2 is available (or undo that)
+    void forceScalar(bool scalar);
+}
+
+#endif
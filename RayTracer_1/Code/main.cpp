@@ -1,39 +1,128 @@
+#include "benchmark.h"
 #include "raytracer.h"
 
+#include <exception>
 #include <iostream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
+namespace
+{
+    void usage(char const *program)
+    {
+        cerr << "Usage: " << program << " in-file [out-file.png]\n"
+                "       " << program << " --bench [options] in-file...\n"
+                "Benchmark options:\n"
+                "  --runs N       render every scene N times (default 3)\n"
+                "  --json FILE    write the results to FILE as JSON\n"
+                "  --csv FILE     write the results to FILE as CSV\n"
+                "  --min-psnr DB  fail if an image's PSNR against its reference is\n"
+                "                 below DB dB (default 40)\n";
+    }
+
+    // Benchmark the scenes, returns the exit code of the program
+    int benchmark(vector<string> const &files, unsigned runs, double minPSNR,
+                  string const &jsonFile, string const &csvFile)
+    try
+    {
+        Benchmark bench(runs, minPSNR);
+        for (string const &file : files)
+        {
+            cout << "Benchmarking " << file << "...\n";
+            if (!bench.run(file))
+            {
+                cerr << "Error: reading scene from " << file << " failed.\n";
+                return 1;
+            }
+        }
+
+        cout << '\n';
+        bench.report(cout);
+
+        if (!jsonFile.empty())
+            bench.writeJSON(jsonFile);
+        if (!csvFile.empty())
+            bench.writeCSV(csvFile);
+
+        return bench.passed() ? 0 : 2;
+    }
+    catch (exception const &ex)
+    {
+        cerr << "Error: " << ex.what() << '\n';
+        return 1;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     cout << "Computer Graphics - Ray tracer\n\n";
 
-    if (argc < 2 || argc > 3)
+    // Separate the options from the file names
+    vector<string> files;
+    bool bench = false;
+    unsigned runs = 3;
+    double minPSNR = 40;
+    string jsonFile;
+    string csvFile;
+
+    try
+    {
+        for (int idx = 1; idx < argc; ++idx)
+        {
+            string arg = argv[idx];
+            if (arg == "--bench")
+                bench = true;
+            else if (arg == "--runs" && idx + 1 < argc)
+                runs = stoul(argv[++idx]);
+            else if (arg == "--json" && idx + 1 < argc)
+                jsonFile = argv[++idx];
+            else if (arg == "--csv" && idx + 1 < argc)
+                csvFile = argv[++idx];
+            else if (arg == "--min-psnr" && idx + 1 < argc)
+                minPSNR = stod(argv[++idx]);
+            else if (arg.compare(0, 2, "--") == 0)
+                throw invalid_argument("unknown option " + arg);
+            else
+                files.push_back(arg);
+        }
+    }
+    catch (exception const &ex)
+    {
+        cerr << "Error: invalid arguments (" << ex.what() << ").\n";
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (bench && !files.empty())
+        return benchmark(files, runs, minPSNR, jsonFile, csvFile);
+
+    if (files.size() < 1 || files.size() > 2)
     {
-        cerr << "Usage: " << argv[0] << " in-file [out-file.png]\n";
+        usage(argv[0]);
         return 1;
     }
 
     Raytracer raytracer;
 
     // read the scene
-    if (!raytracer.readScene(argv[1]))
+    if (!raytracer.readScene(files[0]))
     {
-        cerr << "Error: reading scene from " << argv[1] <<
+        cerr << "Error: reading scene from " << files[0] <<
             " failed - no output generated.\n";
         return 1;
     }
 
     // determine output name
     string ofname;
-    if (argc >= 3)
+    if (files.size() >= 2)
     {
-        ofname = argv[2];   // use the provided name
+        ofname = files[1];  // use the provided name
     }
     else
     {
-        ofname = argv[1];   // replace .json with .png
+        ofname = files[0];  // replace .json with .png
         ofname.erase(ofname.begin() + ofname.find_last_of('.'), ofname.end());
         ofname += ".png";
     }
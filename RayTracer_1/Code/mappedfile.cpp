@@ -0,0 +1,95 @@
+#include "mappedfile.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define MAPPEDFILE_MMAP
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile(string const &filename)
+:
+    d_data(nullptr),
+    d_size(0),
+    d_mapped(false)
+{
+#ifdef MAPPEDFILE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("Could not open " + filename + " for reading.");
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            // the file is read front to back
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            d_data = static_cast<char const *>(data);
+            d_size = info.st_size;
+            d_mapped = true;
+        }
+    }
+    close(fd);      // the mapping stays valid
+
+    if (d_mapped)
+        return;
+#endif
+
+    // Fall back to reading the file
+    ifstream file(filename, ios::binary);
+    if (!file)
+        throw runtime_error("Could not open " + filename + " for reading.");
+    d_contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    d_data = d_contents.data();
+    d_size = d_contents.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef MAPPEDFILE_MMAP
+    if (d_mapped)
+        munmap(const_cast<char *>(d_data), d_size);
+#endif
+}
+
+char const *MappedFile::begin() const
+{
+    return d_data;
+}
+
+char const *MappedFile::end() const
+{
+    return d_data + d_size;
+}
+
+size_t MappedFile::size() const
+{
+    return d_size;
+}
+
+bool MappedFile::status(string const &filename, uint64_t &size, int64_t &modified)
+{
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+        return false;
+
+    size = info.st_size;
+#if defined(__APPLE__)
+    modified = info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#elif defined(__unix__)
+    modified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#else
+    modified = info.st_mtime * 1000000000LL;    // whole seconds only
+#endif
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only view of the contents of a file. On POSIX systems the file is
+// memory mapped, so reading it costs no copy; elsewhere (or if mapping
+// fails) it is read into memory.
+class MappedFile
+{
+    char const *d_data;
+    std::size_t d_size;
+    bool d_mapped;
+    std::string d_contents;     // the contents, if not mapped
+
+    public:
+        // throws runtime_error if the file cannot be read
+        explicit MappedFile(std::string const &filename);
+        ~MappedFile();
+
+        MappedFile(MappedFile const &) = delete;
+        MappedFile &operator=(MappedFile const &) = delete;
+
+        char const *begin() const;
+        char const *end() const;
+        std::size_t size() const;
+
+        // Size and modification time (in nanoseconds, as precise as the
+        // system records it) of filename, false if it does not exist.
+        static bool status(std::string const &filename, std::uint64_t &size,
+                           std::int64_t &modified);
+};
+
+#endif
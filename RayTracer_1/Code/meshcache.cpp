@@ -0,0 +1,165 @@
+#include "meshcache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    char const MAGIC[8] = {'R', 'T', '1', 'M', 'E', 'S', 'H', '\0'};
+
+    // increment when the layout of the file or of the cached arrays changes
+    uint32_t const VERSION = 1;
+
+    uint32_t const BYTE_ORDER_MARK = 0x01020304;
+
+    uint64_t const FNV_OFFSET = 14695981039346656037ULL;
+    uint64_t const FNV_PRIME = 1099511628211ULL;
+
+    uint64_t fnv1a(void const *data, size_t size, uint64_t hash = FNV_OFFSET)
+    {
+        unsigned char const *bytes = static_cast<unsigned char const *>(data);
+        for (size_t idx = 0; idx != size; ++idx)
+        {
+            hash ^= bytes[idx];
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+}
+
+MeshCache::MeshCache(string const &objFile, Point const &position,
+                     Vector const &rotation, Vector const &scale)
+:
+    d_objFile(objFile),
+    d_header(),
+    d_pos(nullptr)
+{
+    copy(begin(MAGIC), end(MAGIC), d_header.magic);
+    d_header.version = VERSION;
+    d_header.byteOrder = BYTE_ORDER_MARK;
+
+    Vector const transform[] = {position, rotation, scale};
+    for (unsigned idx = 0; idx != 3; ++idx)
+    {
+        d_header.transform[3 * idx] = transform[idx].x;
+        d_header.transform[3 * idx + 1] = transform[idx].y;
+        d_header.transform[3 * idx + 2] = transform[idx].z;
+    }
+
+    ostringstream name;
+    name << objFile << '.' << hex << setw(8) << setfill('0')
+         << (fnv1a(d_header.transform, sizeof d_header.transform) & 0xffffffff)
+         << ".meshcache";
+    d_filename = name.str();
+}
+
+string const &MeshCache::filename() const
+{
+    return d_filename;
+}
+
+bool MeshCache::open()
+{
+    d_file.reset();
+    if (!statSource(d_header))
+        return false;
+
+    try
+    {
+        d_file.reset(new MappedFile(d_filename));
+    }
+    catch (exception const &)
+    {
+        return false;       // no cache yet
+    }
+
+    Header header;
+    if (d_file->size() < sizeof header)
+        return false;
+    memcpy(&header, d_file->begin(), sizeof header);
+
+    if (!equal(begin(MAGIC), end(MAGIC), header.magic)
+        || header.version != VERSION
+        || header.byteOrder != BYTE_ORDER_MARK
+        || header.objSize != d_header.objSize
+        || !equal(begin(header.transform), end(header.transform),
+                  d_header.transform))
+        return false;
+
+    // A touched (or copied) .obj file may still have the same contents. If
+    // so, the new modification time is stored to skip hashing next time.
+    if (header.objTime != d_header.objTime)
+    {
+        if (header.objHash != hashContents())
+            return false;
+
+        fstream file(d_filename, ios::binary | ios::in | ios::out);
+        file.seekp(offsetof(Header, objTime));
+        file.write(reinterpret_cast<char const *>(&d_header.objTime),
+                   sizeof d_header.objTime);
+    }
+
+    d_pos = d_file->begin() + sizeof header;
+    return true;
+}
+
+bool MeshCache::create()
+{
+    if (!statSource(d_header))
+        return false;
+    d_header.objHash = hashContents();
+
+    // Other processes may write the same cache at the same time: each
+    // writes its own file, the last rename wins.
+    d_tmpFile = d_filename + '.' + to_string(getpid()) + ".tmp";
+    d_out.open(d_tmpFile, ios::binary | ios::trunc);
+    d_out.write(reinterpret_cast<char const *>(&d_header), sizeof d_header);
+    return d_out.good();
+}
+
+bool MeshCache::commit()
+{
+    d_out.close();
+    if (d_out.fail() || rename(d_tmpFile.c_str(), d_filename.c_str()) != 0)
+    {
+        remove(d_tmpFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+// --- Private -----------------------------------------------------------------
+
+bool MeshCache::statSource(Header &header) const
+{
+    return MappedFile::status(d_objFile, header.objSize, header.objTime);
+}
+
+uint64_t MeshCache::hashContents() const
+{
+    MappedFile obj(d_objFile);
+    return fnv1a(obj.begin(), obj.size());
+}
+
+char const *MeshCache::take(size_t size)
+{
+    if (size > static_cast<size_t>(d_file->end() - d_pos))
+        throw runtime_error("Corrupt mesh cache " + d_filename + '.');
+
+    char const *data = d_pos;
+    d_pos += size;
+    return data;
+}
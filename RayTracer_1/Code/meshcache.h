@@ -0,0 +1,133 @@
+#ifndef MESHCACHE_H_
+#define MESHCACHE_H_
+
+#include "mappedfile.h"
+#include "triple.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Binary cache of the data a Mesh derives from an .obj file, so the file
+// does not have to be parsed (and the BVH not built) again on the next run.
+//
+// The cache is stored next to the .obj file, as <file>.obj.<key>.meshcache,
+// where the key is a hash of the transformation applied to the model: the
+// cached triangles are transformed already. The file starts with a header
+// identifying its source (size, modification time and a hash of the
+// contents of the .obj file, and the transformation), followed by a number
+// of arrays of trivially copyable elements in the native byte order. A
+// cache whose source size or transformation differs is stale. If only the
+// modification time differs, the contents of the .obj file are hashed to
+// decide.
+//
+// Reading maps the cache file and copies the arrays out of it:
+//
+//      MeshCache cache(objFile, position, rotation, scale);
+//      if (cache.open())
+//          cache.read(first), cache.read(second), ...
+//
+// Writing goes to a temporary file (unique to the process), which replaces
+// the cache by commit():
+//
+//      cache.create();
+//      cache.write(first), cache.write(second), ...
+//      cache.commit();
+class MeshCache
+{
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint64_t objSize;
+        std::int64_t objTime;       // modification time in nanoseconds
+        std::uint64_t objHash;      // FNV-1a hash of the contents
+        double transform[9];        // position, rotation and scale
+    };
+
+    // Every array is preceded by its element count and size
+    struct ArrayHeader
+    {
+        std::uint64_t count;
+        std::uint64_t elementSize;
+    };
+
+    std::string d_objFile;
+    std::string d_filename;
+    Header d_header;                // header of the current .obj file
+
+    std::unique_ptr<MappedFile> d_file;
+    char const *d_pos;              // next array in d_file
+
+    std::ofstream d_out;
+    std::string d_tmpFile;          // written by create, renamed by commit
+
+    public:
+        MeshCache(std::string const &objFile, Point const &position,
+                  Vector const &rotation, Vector const &scale);
+
+        std::string const &filename() const;
+
+        // Map the cache file and check that it belongs to the current .obj
+        // file and transformation. Returns false if there is no such cache.
+        bool open();
+
+        // Read the next array, throws runtime_error if the file is corrupt
+        template <typename Type>
+        void read(std::vector<Type> &data);
+
+        // Start writing the cache, returns false if it cannot be created
+        bool create();
+
+        template <typename Type>
+        void write(std::vector<Type> const &data);
+
+        // Replace the cache file by the written one, returns false if
+        // writing failed.
+        bool commit();
+
+    private:
+        // Fills in objSize and objTime, returns false if the file is missing
+        bool statSource(Header &header) const;
+
+        std::uint64_t hashContents() const;
+
+        char const *take(std::size_t size);
+};
+
+template <typename Type>
+void MeshCache::read(std::vector<Type> &data)
+{
+    static_assert(std::is_trivially_copyable<Type>::value,
+                  "cached arrays are copied bytewise");
+
+    ArrayHeader array;
+    std::memcpy(&array, take(sizeof array), sizeof array);
+    if (array.elementSize != sizeof(Type)
+        || array.count > (d_file->end() - d_pos) / sizeof(Type))
+        throw std::runtime_error("Corrupt mesh cache " + d_filename + '.');
+
+    data.resize(array.count);
+    std::size_t const size = array.count * sizeof(Type);
+    std::memcpy(data.data(), take(size), size);
+}
+
+template <typename Type>
+void MeshCache::write(std::vector<Type> const &data)
+{
+    static_assert(std::is_trivially_copyable<Type>::value,
+                  "cached arrays are copied bytewise");
+
+    ArrayHeader array{data.size(), sizeof(Type)};
+    d_out.write(reinterpret_cast<char const *>(&array), sizeof array);
+    d_out.write(reinterpret_cast<char const *>(data.data()),
+                data.size() * sizeof(Type));
+}
+
+#endif
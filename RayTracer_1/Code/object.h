@@ -1,8 +1,6 @@
 #ifndef OBJECT_H_
 #define OBJECT_H_
 
-#include "material.h"
-
 // not really needed here, but deriving classes may need them
 #include "hit.h"
 #include "ray.h"
@@ -15,7 +13,8 @@ typedef std::shared_ptr<Object> ObjectPtr;
 class Object
 {
     public:
-        Material material;
+        unsigned materialIndex = 0;     // index in the material table of
+                                        // the scene
 
         virtual ~Object() = default;
 
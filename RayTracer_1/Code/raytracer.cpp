@@ -1,6 +1,8 @@
 #include "raytracer.h"
 
+#include "allocationcounter.h"
 #include "image.h"
+#include "kernels.h"
 #include "light.h"
 #include "material.h"
 #include "triple.h"
@@ -10,6 +12,7 @@
 // =============================================================================
 
 #include "shapes/cylinder.h"
+#include "shapes/instance.h"
 #include "shapes/mesh.h"
 #include "shapes/quad.h"
 #include "shapes/sphere.h"
@@ -21,6 +24,7 @@
 
 #include "json/json.h"
 
+#include <chrono>
 #include <exception>
 #include <fstream>
 #include <iostream>
@@ -62,7 +66,19 @@ bool Raytracer::parseObjectNode(json const &node)
         Point position(node["position"]);
         Vector rotation(node["rotation"]);
         Vector scale(node["scale"]);
-        obj = ObjectPtr(new Mesh(filename, position, rotation, scale));
+        Mesh *mesh = new Mesh(filename, position, rotation, scale);
+        timings.build += mesh->buildTime();
+        obj = ObjectPtr(mesh);
+    }
+    else if (node["type"] == "instance")
+    {
+        // like a mesh, but the geometry is shared with the other instances
+        // of the file
+        string filename = node["filename"];
+        Point position(node["position"]);
+        Vector rotation(node["rotation"]);
+        Vector scale(node["scale"]);
+        obj = ObjectPtr(new Instance(loadMesh(filename), position, rotation, scale));
     }
     else if (node["type"] == "quad")
     {
@@ -85,11 +101,24 @@ bool Raytracer::parseObjectNode(json const &node)
         return false;
 
     // Parse material and add object to the scene
-    obj->material = parseMaterialNode(node["material"]);
+    obj->materialIndex = scene.addMaterial(parseMaterialNode(node["material"]));
     scene.addObject(obj);
     return true;
 }
 
+shared_ptr<Mesh> Raytracer::loadMesh(string const &filename)
+{
+    auto found = meshes.find(filename);
+    if (found != meshes.end())
+        return found->second;
+
+    shared_ptr<Mesh> mesh = make_shared<Mesh>(filename, Point(), Vector(),
+                                              Vector(1, 1, 1));
+    timings.build += mesh->buildTime();
+    meshes[filename] = mesh;
+    return mesh;
+}
+
 Light Raytracer::parseLightNode(json const &node) const
 {
     Point pos(node["position"]);
@@ -111,6 +140,9 @@ bool Raytracer::readScene(string const &ifname)
 try
 {
     // Read and parse input json file
+    auto start = chrono::steady_clock::now();
+    timings.build = 0;
+
     ifstream infile(ifname);
     if (!infile) throw runtime_error("Could not open input file for reading.");
     json jsonscene;
@@ -133,6 +165,15 @@ try
 
     cout << "Parsed " << objCount << " objects.\n";
 
+    auto buildStart = chrono::steady_clock::now();
+    scene.buildAccelerationStructure();
+    timings.build += chrono::duration<double>(
+        chrono::steady_clock::now() - buildStart).count();
+
+    // The meshes build their BVH while they are parsed.
+    timings.parse = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count() - timings.build;
+
 // =============================================================================
 // -- End of scene data reading ------------------------------------------------
 // =============================================================================
@@ -145,13 +186,33 @@ catch (exception const &ex)
     return false;
 }
 
+Raytracer::Timings const &Raytracer::getTimings() const
+{
+    return timings;
+}
+
 void Raytracer::renderToFile(string const &ofname)
 {
     // TODO: the size may be a settings in your file
     Image img(400, 400);
-    cout << "Tracing...\n";
+    cout << "Tracing (" << Kernels::instructionSet() << " kernels)...\n";
+
+    size_t allocations = AllocationCounter::count();
+    auto start = chrono::steady_clock::now();
     scene.render(img);
+    timings.trace = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+    allocations = AllocationCounter::count() - allocations;
+
+    // Tracing should not allocate anything per ray once the scene is loaded.
+    if (AllocationCounter::enabled())
+        cout << "Heap allocations while tracing " << img.width() * img.height()
+             << " rays: " << allocations << ".\n";
+
     cout << "Writing image to " << ofname << "...\n";
+    start = chrono::steady_clock::now();
     img.write_png(ofname);
+    timings.encode = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
     cout << "Done.\n";
 }
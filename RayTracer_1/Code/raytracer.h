@@ -3,27 +3,50 @@
 
 #include "scene.h"
 
+#include <map>
+#include <memory>
 #include <string>
 
 // Forward declerations
 class Light;
 class Material;
+class Mesh;
 
 #include "json/json_fwd.h"
 
 class Raytracer
 {
-    Scene scene;
+    public:
+        // duration (in seconds) of the stages of readScene and renderToFile
+        struct Timings
+        {
+            double parse = 0;   // reading the scene file and models
+            double build = 0;   // building the BVHs of the meshes
+            double trace = 0;   // rendering the image
+            double encode = 0;  // writing the image to a PNG file
+        };
+
+    private:
+        Scene scene;
+        Timings timings;
+
+        // meshes shared by the instances, by file name
+        std::map<std::string, std::shared_ptr<Mesh>> meshes;
 
     public:
 
         bool readScene(std::string const &ifname);
         void renderToFile(std::string const &ofname);
 
+        Timings const &getTimings() const;
+
     private:
 
         bool parseObjectNode(nlohmann::json const &node);
 
+        // the mesh in filename, untransformed, loaded on first use
+        std::shared_ptr<Mesh> loadMesh(std::string const &filename);
+
         Light parseLightNode(nlohmann::json const &node) const;
         Material parseMaterialNode(nlohmann::json const &node) const;
 };
@@ -2,35 +2,165 @@
 
 #include "hit.h"
 #include "image.h"
-#include "material.h"
 #include "ray.h"
+#include "shapes/instance.h"
+#include "shapes/sphere.h"
+#include "shapes/triangle.h"
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include <iostream>
 
 using namespace std;
 
-Color Scene::trace(Ray const &ray)
+pair<ObjectPtr, Hit> Scene::castRay(Ray const &ray) const
 {
-    // Find hit object and distance
-    Hit min_hit(numeric_limits<double>::infinity(), Vector());
-    ObjectPtr obj = nullptr;
-    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    // Find the closest object; equally close hits resolve to the object
+    // which was added first.
+    double tMax = numeric_limits<double>::infinity();
+    unsigned best = objects.size();
+    Hit other = Hit::NO_HIT();
+    auto update = [&](double t, unsigned idx)
     {
-        Hit hit(objects[idx]->intersect(ray));
-        if (hit.t < min_hit.t)
+        if (t < tMax || (t == tMax && idx < best))
         {
-            min_hit = hit;
-            obj = objects[idx];
+            tMax = t;
+            best = idx;
+            return true;
         }
+        return false;
+    };
+
+    double t[Kernels::BLOCK_SIZE];
+    for (unsigned block = 0; block != sphereBlocks.size(); ++block)
+    {
+        Kernels::intersectSpheres(ray, sphereBlocks[block], t);
+        for (unsigned lane = 0; lane != Kernels::BLOCK_SIZE; ++lane)
+            if (t[lane] == t[lane])     // not NaN, so lane is in use
+                update(t[lane], sphereObjects[block * Kernels::BLOCK_SIZE + lane]);
+    }
+
+    for (unsigned block = 0; block != triangleBlocks.size(); ++block)
+    {
+        Kernels::intersectTriangles(ray, triangleBlocks[block], t);
+        for (unsigned lane = 0; lane != Kernels::BLOCK_SIZE; ++lane)
+            if (t[lane] == t[lane])
+                update(t[lane], triangleObjects[block * Kernels::BLOCK_SIZE + lane]);
+    }
+
+    for (unsigned idx : otherObjects)
+    {
+        Hit hit = objects[idx]->intersect(ray);
+        if (update(hit.t, idx))
+            other = hit;
     }
 
+    closestInstance(ray, tMax, best, other);
+
+    if (best == objects.size())
+        return pair<ObjectPtr, Hit>(nullptr, Hit::NO_HIT());
+
+    return pair<ObjectPtr, Hit>(objects[best], hitOf(best, ray, tMax, other));
+}
+
+void Scene::castPacket(vector<Ray> const &rays,
+                       vector<pair<ObjectPtr, Hit>> &hits) const
+{
+    using Kernels::BLOCK_SIZE;
+    using Kernels::PACKET_SIZE;
+
+    unsigned count = rays.size();
+
+    // Unused lanes repeat the last ray; their results are ignored.
+    Kernels::RayPacket packet;
+    for (unsigned lane = 0; lane != PACKET_SIZE; ++lane)
+        packet.set(lane, rays[lane < count ? lane : count - 1]);
+
+    double tMax[PACKET_SIZE];
+    unsigned best[PACKET_SIZE];
+    vector<Hit> other(count, Hit::NO_HIT());
+    for (unsigned lane = 0; lane != PACKET_SIZE; ++lane)
+    {
+        tMax[lane] = numeric_limits<double>::infinity();
+        best[lane] = objects.size();
+    }
+    // only the lanes in use: other objects are only tested for those
+    auto update = [&](double const *t, unsigned idx)
+    {
+        for (unsigned lane = 0; lane != count; ++lane)
+            if (t[lane] < tMax[lane] || (t[lane] == tMax[lane] && idx < best[lane]))
+            {
+                tMax[lane] = t[lane];
+                best[lane] = idx;
+            }
+    };
+
+    double t[PACKET_SIZE];
+    for (unsigned idx = 0; idx != sphereObjects.size(); ++idx)
+    {
+        Kernels::SphereBlock const &block = sphereBlocks[idx / BLOCK_SIZE];
+        unsigned lane = idx % BLOCK_SIZE;
+        Kernels::intersectSphere(packet,
+            Point(block.cx[lane], block.cy[lane], block.cz[lane]),
+            block.r[lane], t);
+        update(t, sphereObjects[idx]);
+    }
+
+    for (unsigned idx = 0; idx != triangleObjects.size(); ++idx)
+    {
+        Kernels::TriangleBlock const &block = triangleBlocks[idx / BLOCK_SIZE];
+        unsigned lane = idx % BLOCK_SIZE;
+        Kernels::intersectTriangle(packet,
+            Point(block.v0x[lane], block.v0y[lane], block.v0z[lane]),
+            Vector(block.e1x[lane], block.e1y[lane], block.e1z[lane]),
+            Vector(block.e2x[lane], block.e2y[lane], block.e2z[lane]), t);
+        update(t, triangleObjects[idx]);
+    }
+
+    for (unsigned idx : otherObjects)
+        for (unsigned lane = 0; lane != count; ++lane)
+        {
+            Hit hit = objects[idx]->intersect(rays[lane]);
+            if (hit.t < tMax[lane] || (hit.t == tMax[lane] && idx < best[lane]))
+            {
+                tMax[lane] = hit.t;
+                best[lane] = idx;
+                other[lane] = hit;
+            }
+        }
+
+    // Instances are found ray by ray, through their BVH
+    for (unsigned lane = 0; lane != count; ++lane)
+        closestInstance(rays[lane], tMax[lane], best[lane], other[lane]);
+
+    hits.clear();
+    for (unsigned lane = 0; lane != count; ++lane)
+    {
+        if (best[lane] == objects.size())
+            hits.push_back(pair<ObjectPtr, Hit>(nullptr, Hit::NO_HIT()));
+        else
+            hits.push_back(pair<ObjectPtr, Hit>(objects[best[lane]],
+                                                hitOf(best[lane], rays[lane], tMax[lane],
+                                                      other[lane])));
+    }
+}
+
+Color Scene::trace(Ray const &ray)
+{
+    return shade(ray, castRay(ray));
+}
+
+Color Scene::shade(Ray const &ray, pair<ObjectPtr, Hit> const &mainhit)
+{
+    ObjectPtr const &obj = mainhit.first;
+    Hit const &min_hit = mainhit.second;
+
     // No hit? Return background color.
     if (!obj)
         return Color(0.0, 0.0, 0.0);
 
-    Material material = obj->material;          // the hit objects material
+    Material const &material = materials[obj->materialIndex];
     Point hit = ray.at(min_hit.t);              // the hit point
     Vector N = min_hit.N;                       // the normal at hit point
     Vector V = -ray.D;                          // the view vector
@@ -80,24 +210,119 @@ void Scene::render(Image &img)
 {
     unsigned w = img.width();
     unsigned h = img.height();
+
+    vector<Ray> rays;
+    vector<pair<ObjectPtr, Hit>> hits;
+    rays.reserve(Kernels::PACKET_SIZE);
+    hits.reserve(Kernels::PACKET_SIZE);
+
     for (unsigned y = 0; y < h; ++y)
     {
-        for (unsigned x = 0; x < w; ++x)
+        // Primary rays of neighbouring pixels are coherent: intersect them
+        // as packets.
+        for (unsigned x0 = 0; x0 < w; x0 += Kernels::PACKET_SIZE)
         {
-            Point pixel(x + 0.5, h - 1 - y + 0.5, 0);
-            Ray ray(eye, (pixel - eye).normalized());
-            Color col = trace(ray);
-            col.clamp();
-            img(x, y) = col;
+            unsigned count = min(Kernels::PACKET_SIZE, w - x0);
+
+            rays.clear();
+            for (unsigned x = x0; x != x0 + count; ++x)
+            {
+                Point pixel(x + 0.5, h - 1 - y + 0.5, 0);
+                rays.push_back(Ray(eye, (pixel - eye).normalized()));
+            }
+
+            castPacket(rays, hits);
+
+            for (unsigned lane = 0; lane != count; ++lane)
+            {
+                Color col = shade(rays[lane], hits[lane]);
+                col.clamp();
+                img(x0 + lane, y) = col;
+            }
         }
     }
 }
 
+void Scene::buildAccelerationStructure()
+{
+    if (instanceObjects.empty())
+        return;
+
+    vector<AABB> boxes;
+    for (unsigned idx : instanceObjects)
+        boxes.push_back(static_cast<Instance const &>(*objects[idx]).boundingBox());
+    instanceBVH.build(boxes);
+
+    // store the instances in the leaf order
+    vector<unsigned> ordered;
+    for (unsigned idx : instanceBVH.order())
+        ordered.push_back(instanceObjects[idx]);
+    instanceObjects.swap(ordered);
+
+    cout << "Built BVH over " << instanceObjects.size() << " instances ("
+         << instanceBVH.numNodes() << " nodes).\n";
+}
+
+// --- Private -----------------------------------------------------------------
+
+Hit Scene::hitOf(unsigned idx, Ray const &ray, double t, Hit const &other) const
+{
+    Object *obj = objects[idx].get();
+    if (Sphere const *sphere = dynamic_cast<Sphere const *>(obj))
+        return Hit(t, sphere->normal(ray, t));
+    if (Triangle const *tri = dynamic_cast<Triangle const *>(obj))
+        return Hit(t, tri->N);
+    return other;
+}
+
+void Scene::closestInstance(Ray const &ray, double &tMax, unsigned &best,
+                            Hit &hit) const
+{
+    instanceBVH.traverse(ray, tMax, [&](unsigned first, unsigned count, double &tMax)
+    {
+        for (unsigned pos = first; pos != first + count; ++pos)
+        {
+            unsigned idx = instanceObjects[pos];
+            Hit instanceHit = objects[idx]->intersect(ray);
+            if (instanceHit.t < tMax || (instanceHit.t == tMax && idx < best))
+            {
+                tMax = instanceHit.t;
+                best = idx;
+                hit = instanceHit;
+            }
+        }
+        return false;
+    });
+}
+
 // --- Misc functions ----------------------------------------------------------
 
 void Scene::addObject(ObjectPtr obj)
 {
+    unsigned idx = objects.size();
     objects.push_back(obj);
+
+    using Kernels::BLOCK_SIZE;
+    if (Sphere const *sphere = dynamic_cast<Sphere const *>(obj.get()))
+    {
+        if (sphereObjects.size() % BLOCK_SIZE == 0)
+            sphereBlocks.push_back(Kernels::SphereBlock());
+        sphereBlocks.back().set(sphereObjects.size() % BLOCK_SIZE,
+                                sphere->position, sphere->r);
+        sphereObjects.push_back(idx);
+    }
+    else if (Triangle const *tri = dynamic_cast<Triangle const *>(obj.get()))
+    {
+        if (triangleObjects.size() % BLOCK_SIZE == 0)
+            triangleBlocks.push_back(Kernels::TriangleBlock());
+        triangleBlocks.back().set(triangleObjects.size() % BLOCK_SIZE,
+                                  tri->v0, tri->v1 - tri->v0, tri->v2 - tri->v0);
+        triangleObjects.push_back(idx);
+    }
+    else if (dynamic_cast<Instance const *>(obj.get()))
+        instanceObjects.push_back(idx);
+    else
+        otherObjects.push_back(idx);
 }
 
 void Scene::addLight(Light const &light)
@@ -105,6 +330,12 @@ void Scene::addLight(Light const &light)
     lights.push_back(LightPtr(new Light(light)));
 }
 
+unsigned Scene::addMaterial(Material const &material)
+{
+    materials.push_back(material);
+    return materials.size() - 1;
+}
+
 void Scene::setEye(Triple const &position)
 {
     eye = position;
@@ -1,10 +1,14 @@
 #ifndef SCENE_H_
 #define SCENE_H_
 
+#include "bvh.h"
+#include "kernels.h"
 #include "light.h"
+#include "material.h"
 #include "object.h"
 #include "triple.h"
 
+#include <utility>
 #include <vector>
 
 // Forward declerations
@@ -15,23 +19,68 @@ class Scene
 {
     std::vector<ObjectPtr> objects;
     std::vector<LightPtr> lights;   // no ptr needed, but kept for consistency
+    std::vector<Material> materials;    // referenced by Object::materialIndex
     Point eye;
 
+    // Spheres and triangles are also packed in blocks for the vectorized
+    // kernels, with the index of their object per lane. Other objects are
+    // intersected through the Object interface.
+    std::vector<Kernels::SphereBlock> sphereBlocks;
+    std::vector<unsigned> sphereObjects;
+    std::vector<Kernels::TriangleBlock> triangleBlocks;
+    std::vector<unsigned> triangleObjects;
+    std::vector<unsigned> otherObjects;
+
+    // Mesh instances are found through a BVH over their bounding boxes,
+    // the top level above the BVHs of the meshes themselves. After
+    // buildAccelerationStructure, instanceObjects is in the leaf order of
+    // instanceBVH.
+    std::vector<unsigned> instanceObjects;
+    BVH instanceBVH;
+
     public:
 
+        // determine closest hit (if any)
+        std::pair<ObjectPtr, Hit> castRay(Ray const &ray) const;
+
+        // determine closest hits for a packet of at most
+        // Kernels::PACKET_SIZE (primary) rays
+        void castPacket(std::vector<Ray> const &rays,
+                        std::vector<std::pair<ObjectPtr, Hit>> &hits) const;
+
         // trace a ray into the scene and return the color
         Color trace(Ray const &ray);
 
+        // color of the hit of a ray
+        Color shade(Ray const &ray, std::pair<ObjectPtr, Hit> const &hit);
+
         // render the scene to the given image
         void render(Image &img);
 
+        // (re)build the BVH over the instances, call after adding objects
+        void buildAccelerationStructure();
 
         void addObject(ObjectPtr obj);
         void addLight(Light const &light);
+
+        // add a material to the table, returns its index
+        unsigned addMaterial(Material const &material);
         void setEye(Triple const &position);
 
         unsigned getNumObject();
         unsigned getNumLights();
+
+    private:
+        // The Hit of object idx, which ray hits at distance t. The kernels
+        // only give the distance of spheres and triangles, so their normal
+        // is computed here; other objects and instances returned their Hit
+        // (other) when they were tested.
+        Hit hitOf(unsigned idx, Ray const &ray, double t, Hit const &other) const;
+
+        // Find the instances hit before tMax. On a hit, tMax, best and hit
+        // are updated; equally close hits resolve to the lowest index.
+        void closestInstance(Ray const &ray, double &tMax, unsigned &best,
+                             Hit &hit) const;
 };
 
 #endif
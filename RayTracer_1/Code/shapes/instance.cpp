@@ -0,0 +1,57 @@
+#include "instance.h"
+
+#include "mesh.h"
+
+#include <cmath>
+
+using namespace std;
+
+Hit Instance::intersect(Ray const &ray)
+{
+    Vector O = ray.O - d_position;
+    Ray local(Point(d_inverse[0].dot(O), d_inverse[1].dot(O), d_inverse[2].dot(O)),
+              Vector(d_inverse[0].dot(ray.D), d_inverse[1].dot(ray.D),
+                     d_inverse[2].dot(ray.D)));
+
+    Hit hit = d_mesh->intersect(local);
+    if (std::isnan(hit.t))
+        return hit;
+
+    // Normals transform with the transpose of the inverse
+    Vector N = hit.N.x * d_inverse[0] + hit.N.y * d_inverse[1]
+               + hit.N.z * d_inverse[2];
+    return Hit(hit.t, N.normalized());
+}
+
+AABB const &Instance::boundingBox() const
+{
+    return d_box;
+}
+
+Instance::Instance(shared_ptr<Mesh> const &mesh, Point const &position,
+                   Vector const &rotation, Vector const &scale)
+:
+    d_mesh(mesh),
+    d_position(position)
+{
+    // The columns are the images of the axes
+    d_linear[0] = d_mesh->rotate(Vector(scale.x, 0, 0), rotation);
+    d_linear[1] = d_mesh->rotate(Vector(0, scale.y, 0), rotation);
+    d_linear[2] = d_mesh->rotate(Vector(0, 0, scale.z), rotation);
+
+    double det = d_linear[0].dot(d_linear[1].cross(d_linear[2]));
+    d_inverse[0] = d_linear[1].cross(d_linear[2]) / det;
+    d_inverse[1] = d_linear[2].cross(d_linear[0]) / det;
+    d_inverse[2] = d_linear[0].cross(d_linear[1]) / det;
+
+    // Bound the transformed corners of the box of the mesh
+    AABB box = d_mesh->boundingBox();
+    for (unsigned corner = 0; corner != 8; ++corner)
+    {
+        Point p(corner & 1 ? box.max.x : box.min.x,
+                corner & 2 ? box.max.y : box.min.y,
+                corner & 4 ? box.max.z : box.min.z);
+        d_box.extend(p.x * d_linear[0] + p.y * d_linear[1] + p.z * d_linear[2]
+                     + d_position);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef INSTANCE_H_
+#define INSTANCE_H_
+
+#include "../aabb.h"
+#include "../object.h"
+
+#include <memory>
+
+class Mesh;
+
+// A placement of a mesh which is shared with other instances. The mesh is
+// stored once, in object space; every instance only adds its affine
+// transformation. Rays are transformed into object space to intersect the
+// mesh. The direction is not normalized there, so distances along the ray
+// are the same in both spaces.
+//
+// The scene keeps the instances in a BVH of their own (see
+// Scene::buildAccelerationStructure), above the BVHs of the meshes.
+class Instance: public Object
+{
+    std::shared_ptr<Mesh> d_mesh;
+
+    // object to world: p -> d_linear * p + d_position, where the columns of
+    // the matrix are stored. d_inverse holds the rows of its inverse.
+    Point d_position;
+    Vector d_linear[3];
+    Vector d_inverse[3];
+
+    AABB d_box;     // in world space
+
+    public:
+        // The mesh is scaled per axis, rotated by rotation.x, .y and .z
+        // radians around the x, y and z axes (in that order) and then
+        // moved to position, like a Mesh loaded with that transformation.
+        Instance(std::shared_ptr<Mesh> const &mesh, Point const &position,
+                 Vector const &rotation, Vector const &scale);
+
+        virtual Hit intersect(Ray const &ray);
+
+        AABB const &boundingBox() const;
+};
+
+#endif
@@ -1,42 +1,47 @@
 #include "mesh.h"
 
+#include "../meshcache.h"
 #include "../objloader.h"
 #include "../vertex.h"
 #include "triangle.h"
 
+#include <chrono>
+#include <exception>
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <utility>
 
 using namespace std;
 
 Hit Mesh::intersect(Ray const &ray)
 {
-    // Replace the return of a NO_HIT by determining the intersection based
-    // on the ray and this class's data members.
-
-	Hit min_hit(numeric_limits<double>::infinity(), Vector());
-	Hit best_hit(numeric_limits<double>::infinity(), Vector());
-	bool hits = false;
-
-	for (size_t i = 0; i != d_tris.size(); ++i) {
-		ObjectPtr tri = d_tris[i];
-		
-		Hit intersect = tri->intersect(ray);
-		if (intersect.t < min_hit.t) {
-			if (intersect.t < best_hit.t) {
-				best_hit.t = intersect.t;
-				best_hit.N = intersect.N;
-			}
-			hits = true;
-		}
-	}
-
-	if (hits) {
-		return best_hit;
-	}
-
-    return Hit::NO_HIT();
+    // Find the closest triangle in the leaves of the BVH. Equally close hits
+    // (on shared edges) resolve to the triangle which came first in the file.
+    vector<unsigned> const &order = d_bvh.order();
+    double tMax = numeric_limits<double>::infinity();
+    unsigned best = d_tris.size();
+
+    d_bvh.traverse(ray, tMax, [&](unsigned first, unsigned count, double &tMax)
+    {
+        double dist[Kernels::BLOCK_SIZE];
+        Kernels::intersectTriangles(ray, d_blocks[d_leafBlock[first]], dist);
+        for (unsigned idx = first; idx != first + count; ++idx)
+        {
+            double t = dist[idx - first];
+            if (t < tMax || (t == tMax && order[idx] < order[best]))
+            {
+                tMax = t;
+                best = idx;
+            }
+        }
+        return false;
+    });
+
+    if (best == d_tris.size())
+        return Hit::NO_HIT();
+
+    return Hit(tMax, d_tris[best].N);
 }
 
 Vector Mesh::rotate(Vector v, Vector r) {
@@ -59,9 +64,45 @@ Vector Mesh::rotate(Vector v, Vector r) {
 }
 
 Mesh::Mesh(string const &filename, Point const &position, Vector const &rotation, Vector const &scale)
+:
+    d_buildTime(0)
+{
+    // Use the binary cache of an earlier run if the .obj file and the
+    // transformation are unchanged
+    MeshCache cache(filename, position, rotation, scale);
+    auto start = chrono::steady_clock::now();
+    if (readCache(cache))
+    {
+        double readTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Loaded model: " << filename << " with " << d_tris.size() <<
+            " triangles from " << cache.filename() << " (BVH: " <<
+            d_bvh.numNodes() << " nodes, read in " << readTime * 1E3 << " ms).\n";
+        return;
+    }
+
+    build(filename, position, rotation, scale);
+    writeCache(cache);
+}
+
+double Mesh::buildTime() const
+{
+    return d_buildTime;
+}
+
+AABB Mesh::boundingBox() const
+{
+    return d_bvh.empty() ? AABB() : d_bvh.nodes()[0].box;
+}
+
+// --- Private -----------------------------------------------------------------
+
+void Mesh::build(string const &filename, Point const &position, Vector const &rotation, Vector const &scale)
 {
     OBJLoader model(filename);
-    d_tris.reserve(model.numTriangles());
+    vector<MeshTriangle> tris;
+    tris.reserve(model.numTriangles());
+    vector<AABB> boxes;
+    boxes.reserve(model.numTriangles());
     vector<Vertex> vertices = model.vertex_data();
     for (size_t tri = 0; tri != model.numTriangles(); ++tri)
     {
@@ -92,9 +133,87 @@ Mesh::Mesh(string const &filename, Point const &position, Vector const &rotation
 		v1 = v1 + position;
 		v2 = v2 + position;
 
-        d_tris.push_back(ObjectPtr(new Triangle(v0, v1, v2)));
+        Vector N = (v1 - v0).cross(v2 - v0);
+        N.normalize();
+        tris.push_back(MeshTriangle{v0, v1 - v0, v2 - v0, N});
+
+        AABB box;
+        box.extend(v0);
+        box.extend(v1);
+        box.extend(v2);
+        boxes.push_back(box);
+    }
+
+    // Build the BVH and store the triangles in its leaf order
+    auto start = chrono::steady_clock::now();
+    d_bvh.build(boxes);
+    d_tris.reserve(tris.size());
+    for (unsigned idx : d_bvh.order())
+        d_tris.push_back(tris[idx]);
+
+    static_assert(BVH::MAX_LEAF_SIZE <= Kernels::BLOCK_SIZE,
+                  "a leaf must fit in a single block");
+    d_leafBlock.resize(d_tris.size());
+    for (BVH::Node const &node : d_bvh.nodes())
+    {
+        if (node.count == 0)
+            continue;
+
+        Kernels::TriangleBlock block;
+        for (unsigned lane = 0; lane != node.count; ++lane)
+        {
+            MeshTriangle const &tri = d_tris[node.offset + lane];
+            block.set(lane, tri.v0, tri.edge1, tri.edge2);
+        }
+        d_leafBlock[node.offset] = d_blocks.size();
+        d_blocks.push_back(block);
     }
+    d_buildTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
     cout << "Loaded model: " << filename << " with " <<
-        model.numTriangles() << " triangles.\n";
+        model.numTriangles() << " triangles (BVH: " << d_bvh.numNodes() <<
+        " nodes, built in " << d_buildTime * 1E3 << " ms).\n";
+}
+
+bool Mesh::readCache(MeshCache &cache)
+try
+{
+    if (!cache.open())
+        return false;
+
+    vector<BVH::Node> nodes;
+    vector<unsigned> order;
+    cache.read(d_tris);
+    cache.read(nodes);
+    cache.read(order);
+    cache.read(d_blocks);
+    cache.read(d_leafBlock);
+    d_bvh.assign(move(nodes), move(order));
+    return true;
+}
+catch (exception const &ex)
+{
+    // rebuild from the .obj file instead
+    cerr << "Warning: " << ex.what() << '\n';
+    d_tris.clear();
+    d_blocks.clear();
+    d_leafBlock.clear();
+    return false;
+}
+
+void Mesh::writeCache(MeshCache &cache) const
+{
+    // Failing to write the cache (e.g. in a read-only directory) only costs
+    // time on the next run
+    if (cache.create())
+    {
+        cache.write(d_tris);
+        cache.write(d_bvh.nodes());
+        cache.write(d_bvh.order());
+        cache.write(d_blocks);
+        cache.write(d_leafBlock);
+        if (cache.commit())
+            return;
+    }
+    cerr << "Warning: could not write mesh cache " << cache.filename() << ".\n";
 }
@@ -1,14 +1,38 @@
 #ifndef MESH_H_
 #define MESH_H_
 
+#include "../aabb.h"
+#include "../bvh.h"
+#include "../kernels.h"
 #include "../object.h"
 
 #include <string>
 #include <vector>
 
+class MeshCache;
+
 class Mesh: public Object
 {
-    std::vector<ObjectPtr> d_tris;
+    // Triangles are stored by value, in the leaf order of d_bvh, with their
+    // edges precomputed for the intersection test.
+    struct MeshTriangle
+    {
+        Point v0;
+        Vector edge1;   // v1 - v0
+        Vector edge2;   // v2 - v0
+        Vector N;
+    };
+
+    std::vector<MeshTriangle> d_tris;
+    BVH d_bvh;
+
+    // The triangles of every leaf packed for the vectorized kernels.
+    // d_leafBlock maps the first triangle of a leaf to its block.
+    std::vector<Kernels::TriangleBlock> d_blocks;
+    std::vector<unsigned> d_leafBlock;
+
+    double d_buildTime;     // seconds spent building the BVH and blocks
+                            // (0 if they were read from the cache)
 
     public:
         Mesh(std::string const &filename,
@@ -17,9 +41,22 @@ class Mesh: public Object
              Vector const &scale);
 
         virtual Hit intersect(Ray const &ray);
+
+        double buildTime() const;
+
+        // bounds of the triangles (empty for a mesh without triangles)
+        AABB boundingBox() const;
 		
 		Vector rotate(Vector v, Vector r);
 
+    private:
+        // parse the .obj file and build the BVH and blocks
+        void build(std::string const &filename, Point const &position,
+                   Vector const &rotation, Vector const &scale);
+
+        // returns false if there is no (valid) cache
+        bool readCache(MeshCache &cache);
+        void writeCache(MeshCache &cache) const;
 };
 
 #endif
@@ -38,33 +38,35 @@ Hit Sphere::intersect(Ray const &ray)
 		double c = OC.dot(OC) - r*r;
 		double d = b*b - 4*a*c;
 		
-		bool inSphere = abs(OC.length()) < r;
-		
 		if(d < 0.0) {
 			return Hit::NO_HIT();
 		} else {
 			double numerator = -b - sqrt(d);
 			if (numerator > 0.0) {
 				double t = numerator / (2.0 * a);
-				Vector N = t*ray.D + OC;
-				N.normalize();
-				if (inSphere) N = -N;
-				return Hit(t, N);
+				return Hit(t, normal(ray, t));
 			}
 
 			numerator = -b + sqrt(d);
 			if (numerator > 0.0) {
 				double t = numerator / (2.0 * a);
-				Vector N = t*ray.D + OC;
-				N.normalize();
-				if (inSphere) N = -N;
-				return Hit(t, N);
+				return Hit(t, normal(ray, t));
 			} else {
 				return Hit::NO_HIT();
 			}
 		}
 }
 
+Vector Sphere::normal(Ray const &ray, double t) const
+{
+    Vector OC = ray.O - position;
+    Vector N = t * ray.D + OC;
+    N.normalize();
+    if (abs(OC.length()) < r)   // seen from inside
+        N = -N;
+    return N;
+}
+
 Sphere::Sphere(Point const &pos, double radius)
 :
     position(pos),
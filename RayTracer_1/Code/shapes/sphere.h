@@ -10,6 +10,9 @@ class Sphere: public Object
 
         virtual Hit intersect(Ray const &ray);
 
+        // normal where ray hits the sphere at distance t
+        Vector normal(Ray const &ray, double t) const;
+
         Point const position;
         double const r;
 };
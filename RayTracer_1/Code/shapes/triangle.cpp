@@ -1,41 +1,50 @@
 #include "triangle.h"
 
+#include <limits>
+
+using namespace std;
+
 Hit Triangle::intersect(Ray const &ray)
+{
+    double t = mollerTrumbore(ray, v0, v1 - v0, v2 - v0);
+    if (t == t)     // not NaN
+        return Hit(t, N);
+    return Hit::NO_HIT();
+}
+
+double Triangle::mollerTrumbore(Ray const &ray, Point const &v0,
+                                Vector const &edge1, Vector const &edge2)
 {
 	const double EPSILON = 0.0000001;
+    const double NO_HIT = numeric_limits<double>::quiet_NaN();
 
 	double a,f,u,v;
-	Vector edge1, edge2, h, s, q;
-
-	edge1 = v1 - v0;
-    edge2 = v2 - v0;
+    Vector h, s, q;
 
 	h = (ray.D).cross(edge2);
 	a = edge1.dot(h);
 
 	if (a > -EPSILON && a < EPSILON)
-        return Hit::NO_HIT();
+        return NO_HIT;
 
 	f = 1.0/a;
     s = ray.O - v0;
     u = f * s.dot(h);
 
 	if (u < 0.0 || u > 1.0)
-        return Hit::NO_HIT();
+        return NO_HIT;
 
 	q = s.cross(edge1);
     v = f * (ray.D).dot(q);
     if (v < 0.0 || u + v > 1.0)
-        return Hit::NO_HIT();
+        return NO_HIT;
 
 	float t = f * edge2.dot(q);
     if (t > EPSILON) // ray intersection
-    {
-        return Hit(t, N);
-    }
-    else // This means that there is a line intersection but not a ray intersection.
-        return Hit::NO_HIT();
+        return t;
 
+    // This means that there is a line intersection but not a ray intersection.
+    return NO_HIT;
 }
 
 Triangle::Triangle(Point const &v0,
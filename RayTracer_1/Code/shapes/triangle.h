@@ -12,6 +12,12 @@ class Triangle: public Object
 
         virtual Hit intersect(Ray const &ray);
 
+        // Moller-Trumbore test against the triangle (v0, v0 + edge1,
+        // v0 + edge2), shared with Mesh.
+        // Returns the distance along the ray, or NaN if there is no hit.
+        static double mollerTrumbore(Ray const &ray, Point const &v0,
+                                     Vector const &edge1, Vector const &edge2);
+
         Point v0;
         Point v1;
         Point v2;
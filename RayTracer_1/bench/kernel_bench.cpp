@@ -0,0 +1,164 @@
+// Throughput benchmark of the intersection kernels (see Code/kernels.h).
+// Every kernel is run with its scalar and with its AVX2 implementation (if
+// supported) on the same random rays and primitives; the results of both
+// are compared lane by lane.
+
+#include "../Code/kernels.h"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    unsigned const NUM_RAYS = 1 << 12;
+    unsigned const NUM_BLOCKS = 64;
+    unsigned const REPEAT = 16;
+
+    mt19937 rng(42);
+
+    double uniform(double lo, double hi)
+    {
+        return uniform_real_distribution<double>(lo, hi)(rng);
+    }
+
+    Point randomPoint()
+    {
+        return Point(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+    }
+
+    struct Result
+    {
+        double seconds;
+        vector<double> t;   // all distances, to compare implementations
+    };
+
+    // Runs kernel(idx, out) for idx in [0, calls), REPEAT times. Every call
+    // writes width distances.
+    template <typename Kernel>
+    Result run(unsigned calls, unsigned width, Kernel &&kernel)
+    {
+        Result result;
+        result.t.resize(calls * width);
+
+        auto start = chrono::steady_clock::now();
+        for (unsigned rep = 0; rep != REPEAT; ++rep)
+            for (unsigned idx = 0; idx != calls; ++idx)
+                kernel(idx, result.t.data() + idx * width);
+        result.seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    void report(string const &name, unsigned calls, unsigned raysPerCall,
+                unsigned width, Result const &result, Result const *reference)
+    {
+        double rays = double(calls) * raysPerCall * REPEAT;
+        double tests = double(calls) * width * REPEAT;
+
+        cout << left << setw(36) << name << right << fixed << setprecision(1)
+             << setw(10) << rays / result.seconds / 1e6 << " Mrays/s"
+             << setw(10) << tests / result.seconds / 1e6 << " Mtests/s";
+
+        if (reference)
+        {
+            unsigned mismatches = 0;
+            for (unsigned idx = 0; idx != result.t.size(); ++idx)
+                if (memcmp(&result.t[idx], &reference->t[idx], sizeof(double)) != 0)
+                    ++mismatches;
+            cout << setw(8) << setprecision(2)
+                 << reference->seconds / result.seconds << "x, "
+                 << mismatches << " mismatches";
+        }
+        cout << '\n';
+    }
+}
+
+int main()
+{
+    // Rays from around the origin in random directions, and primitives
+    // in the unit cube, so a good fraction of the tests hit.
+    vector<Ray> rays;
+    for (unsigned idx = 0; idx != NUM_RAYS; ++idx)
+        rays.push_back(Ray(Point(uniform(-0.1, 0.1), uniform(-0.1, 0.1), -3),
+                           (randomPoint() - Point(0, 0, -3)).normalized()));
+
+    vector<Kernels::RayPacket> packets(NUM_RAYS / Kernels::PACKET_SIZE);
+    for (unsigned idx = 0; idx != NUM_RAYS; ++idx)
+        packets[idx / Kernels::PACKET_SIZE].set(idx % Kernels::PACKET_SIZE, rays[idx]);
+
+    vector<Kernels::SphereBlock> spheres(NUM_BLOCKS);
+    vector<Kernels::TriangleBlock> triangles(NUM_BLOCKS);
+    for (unsigned block = 0; block != NUM_BLOCKS; ++block)
+        for (unsigned lane = 0; lane != Kernels::BLOCK_SIZE; ++lane)
+        {
+            spheres[block].set(lane, randomPoint(), uniform(0.05, 0.3));
+            Point v0 = randomPoint();
+            triangles[block].set(lane, v0, randomPoint() - v0, randomPoint() - v0);
+        }
+
+    unsigned blockCalls = NUM_RAYS * NUM_BLOCKS;
+    unsigned packetCalls = packets.size() * NUM_BLOCKS;
+
+    auto spheresKernel = [&](unsigned idx, double *t)
+    {
+        Kernels::intersectSpheres(rays[idx / NUM_BLOCKS], spheres[idx % NUM_BLOCKS], t);
+    };
+    auto trianglesKernel = [&](unsigned idx, double *t)
+    {
+        Kernels::intersectTriangles(rays[idx / NUM_BLOCKS], triangles[idx % NUM_BLOCKS], t);
+    };
+    auto spherePacketKernel = [&](unsigned idx, double *t)
+    {
+        Kernels::SphereBlock const &block = spheres[idx % NUM_BLOCKS];
+        Kernels::intersectSphere(packets[idx / NUM_BLOCKS],
+            Point(block.cx[0], block.cy[0], block.cz[0]), block.r[0], t);
+    };
+    auto trianglePacketKernel = [&](unsigned idx, double *t)
+    {
+        Kernels::TriangleBlock const &block = triangles[idx % NUM_BLOCKS];
+        Kernels::intersectTriangle(packets[idx / NUM_BLOCKS],
+            Point(block.v0x[0], block.v0y[0], block.v0z[0]),
+            Vector(block.e1x[0], block.e1y[0], block.e1z[0]),
+            Vector(block.e2x[0], block.e2y[0], block.e2z[0]), t);
+    };
+
+    unsigned const B = Kernels::BLOCK_SIZE;
+    unsigned const P = Kernels::PACKET_SIZE;
+
+    Kernels::forceScalar(true);
+    Result spheresScalar = run(blockCalls, B, spheresKernel);
+    Result trianglesScalar = run(blockCalls, B, trianglesKernel);
+    Result spherePacketScalar = run(packetCalls, P, spherePacketKernel);
+    Result trianglePacketScalar = run(packetCalls, P, trianglePacketKernel);
+
+    cout << "Kernel throughput (" << NUM_RAYS << " rays, "
+         << NUM_BLOCKS * B << " primitives)\n\n";
+    report("scalar: 1 ray x 4 spheres", blockCalls, 1, B, spheresScalar, nullptr);
+    report("scalar: 1 ray x 4 triangles", blockCalls, 1, B, trianglesScalar, nullptr);
+    report("scalar: 8 rays x 1 sphere", packetCalls, P, P, spherePacketScalar, nullptr);
+    report("scalar: 8 rays x 1 triangle", packetCalls, P, P, trianglePacketScalar, nullptr);
+
+    Kernels::forceScalar(false);
+    string isa = Kernels::instructionSet();
+    if (isa == "scalar")
+    {
+        cout << "\nAVX2 is not supported on this CPU.\n";
+        return 0;
+    }
+
+    report(isa + ": 1 ray x 4 spheres", blockCalls, 1, B,
+           run(blockCalls, B, spheresKernel), &spheresScalar);
+    report(isa + ": 1 ray x 4 triangles", blockCalls, 1, B,
+           run(blockCalls, B, trianglesKernel), &trianglesScalar);
+    report(isa + ": 8 rays x 1 sphere", packetCalls, P, P,
+           run(packetCalls, P, spherePacketKernel), &spherePacketScalar);
+    report(isa + ": 8 rays x 1 triangle", packetCalls, P, P,
+           run(packetCalls, P, trianglePacketKernel), &trianglePacketScalar);
+}
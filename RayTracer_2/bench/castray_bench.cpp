@@ -0,0 +1,173 @@
+// Throughput benchmark of Scene::castRay. The primary rays of a scene, and
+// the rays they reflect, are cast on a number of threads at once with
+//  - the virtual Object::intersect of every object, keeping a shared_ptr to
+//    the closest object (the original castRay),
+//  - Scene::castRay, turning its result into a pair<ObjectPtr, Hit> (the
+//    previous interface, which copied the shared_ptr once per ray),
+//  - Scene::castRay and its HitRecord.
+// The shared_ptr copies are atomic reference count updates, which all
+// threads do on the same counters.
+
+#include "../src/hit.h"
+#include "../src/hitrecord.h"
+#include "../src/ray.h"
+#include "../src/raytracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    unsigned const REPEAT = 4;
+    unsigned const TRIALS = 5;      // the fastest trial is reported
+
+    // primary rays through the pixel centers, and the rays they reflect
+    vector<Ray> sceneRays(Scene const &scene)
+    {
+        Camera const &camera = scene.getCamera();
+
+        vector<Ray> rays;
+        for (unsigned y = 0; y != camera.height(); ++y)
+            for (unsigned x = 0; x != camera.width(); ++x)
+            {
+                Scalar screenY = camera.height() - 1 - y + 0.5;
+                rays.push_back(Ray(camera.eye(), camera.direction(x + 0.5, screenY)));
+            }
+
+        unsigned primary = rays.size();
+        for (unsigned idx = 0; idx != primary; ++idx)
+        {
+            Ray const ray = rays[idx];
+            HitRecord record = scene.castRay(ray);
+            if (!record.isHit())
+                continue;
+
+            Vector N = record.N.dot(ray.D) < 0 ? record.N : -record.N;
+            rays.push_back(Ray(ray.at(record.t) + 1E-3 * N, reflect(ray.D, N)));
+        }
+        return rays;
+    }
+
+    pair<ObjectPtr, Hit> castVirtual(Scene const &scene, Ray const &ray)
+    {
+        Hit min_hit(numeric_limits<Scalar>::infinity(), Vector());
+        ObjectPtr obj = nullptr;
+        for (unsigned idx = 0; idx != scene.getNumObject(); ++idx)
+        {
+            Hit hit(scene.getObject(idx)->intersect(ray));
+            if (hit.t < min_hit.t)
+            {
+                min_hit = hit;
+                obj = scene.getObject(idx);
+            }
+        }
+        return pair<ObjectPtr, Hit>(obj, min_hit);
+    }
+
+    pair<ObjectPtr, Hit> castPair(Scene const &scene, Ray const &ray)
+    {
+        HitRecord record = scene.castRay(ray);
+        if (!record.isHit())
+            return pair<ObjectPtr, Hit>(nullptr, Hit(record.t, Vector()));
+        return pair<ObjectPtr, Hit>(scene.getObject(record.prim),
+                                    Hit(record.t, record.N));
+    }
+
+    // Casts all rays REPEAT times on every thread, returns the number of
+    // rays per second and (in hits) the number of hits per pass.
+    template <typename Cast>
+    double run(vector<Ray> const &rays, unsigned threads, unsigned &hits,
+               Cast &&cast)
+    {
+        vector<unsigned> counts(threads);
+        double best = numeric_limits<double>::infinity();
+
+        for (unsigned trial = 0; trial != TRIALS; ++trial)
+        {
+            auto start = chrono::steady_clock::now();
+            vector<thread> pool;
+            for (unsigned thr = 0; thr != threads; ++thr)
+                pool.emplace_back([&, thr]
+                {
+                    unsigned count = 0;
+                    for (unsigned rep = 0; rep != REPEAT; ++rep)
+                        for (Ray const &ray : rays)
+                            count += cast(ray);
+                    counts[thr] = count / REPEAT;
+                });
+            for (thread &thr : pool)
+                thr.join();
+            best = min(best, chrono::duration<double>(
+                chrono::steady_clock::now() - start).count());
+        }
+
+        hits = counts[0];
+        return static_cast<double>(rays.size()) * REPEAT * threads / best;
+    }
+
+    void report(string const &name, double raysPerSecond, double reference)
+    {
+        cout << left << setw(40) << name << right << fixed << setprecision(3)
+             << setw(8) << raysPerSecond / 1E6 << " Mrays/s"
+             << setprecision(2) << setw(8) << raysPerSecond / reference
+             << "x\n";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        cerr << "Usage: " << argv[0] << " scene.json [threads]\n";
+        return 1;
+    }
+
+    unsigned threads = argc == 3 ? stoul(argv[2])
+                                 : max(thread::hardware_concurrency(), 1u);
+
+    Raytracer raytracer;
+    if (!raytracer.readScene(argv[1]))
+        return 1;
+    Scene const &scene = raytracer.getScene();
+
+    vector<Ray> rays = sceneRays(scene);
+    cout << rays.size() << " rays, " << threads << " thread(s)\n\n";
+
+    unsigned hitsVirtual;
+    unsigned hitsPair;
+    unsigned hitsRecord;
+
+    double virtualRate = run(rays, threads, hitsVirtual, [&](Ray const &ray)
+    {
+        return castVirtual(scene, ray).first != nullptr;
+    });
+    double pairRate = run(rays, threads, hitsPair, [&](Ray const &ray)
+    {
+        return castPair(scene, ray).first != nullptr;
+    });
+    double recordRate = run(rays, threads, hitsRecord, [&](Ray const &ray)
+    {
+        return scene.castRay(ray).isHit();
+    });
+
+    report("Object::intersect + shared_ptr", virtualRate, virtualRate);
+    report("castRay + pair<ObjectPtr, Hit>", pairRate, virtualRate);
+    report("castRay + HitRecord", recordRate, virtualRate);
+
+    if (hitsVirtual != hitsRecord || hitsPair != hitsRecord)
+    {
+        cerr << "Error: the number of hits differs (" << hitsVirtual << ", "
+             << hitsPair << ", " << hitsRecord << ").\n";
+        return 1;
+    }
+    return 0;
+}
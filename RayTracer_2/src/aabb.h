@@ -0,0 +1,96 @@
+#ifndef AABB_H_
+#define AABB_H_
+
+#include "triple.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Axis aligned bounding box. A default constructed box is empty: extending
+// it with a point or another box yields exactly that point or box.
+class AABB
+{
+    public:
+        Point min;
+        Point max;
+
+        AABB()
+        :
+            min(std::numeric_limits<Scalar>::infinity(),
+                std::numeric_limits<Scalar>::infinity(),
+                std::numeric_limits<Scalar>::infinity()),
+            max(-std::numeric_limits<Scalar>::infinity(),
+                -std::numeric_limits<Scalar>::infinity(),
+                -std::numeric_limits<Scalar>::infinity())
+        {}
+
+        AABB(Point const &lower, Point const &upper)
+        :
+            min(lower),
+            max(upper)
+        {}
+
+        void extend(Point const &p)
+        {
+            for (unsigned axis = 0; axis != 3; ++axis)
+            {
+                min.data[axis] = std::min(min.data[axis], p.data[axis]);
+                max.data[axis] = std::max(max.data[axis], p.data[axis]);
+            }
+        }
+
+        void extend(AABB const &box)
+        {
+            extend(box.min);
+            extend(box.max);
+        }
+
+        Point center() const
+        {
+            return 0.5 * (min + max);
+        }
+
+        bool isFinite() const
+        {
+            for (unsigned axis = 0; axis != 3; ++axis)
+                if (!std::isfinite(min.data[axis]) || !std::isfinite(max.data[axis]))
+                    return false;
+            return true;
+        }
+
+        Scalar surfaceArea() const
+        {
+            Vector d = max - min;
+            if (d.x < 0.0 || d.y < 0.0 || d.z < 0.0)
+                return 0.0;     // empty box
+            return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        // Slab test. invD holds the reciprocal of the ray direction.
+        // Returns whether the ray enters the box before tMax, and if so the
+        // (clamped to 0) entry distance in tEntry.
+        bool intersect(Point const &O, Vector const &invD, Scalar tMax,
+                       Scalar &tEntry) const
+        {
+            Scalar t0 = 0.0;
+            Scalar t1 = tMax;
+            for (unsigned axis = 0; axis != 3; ++axis)
+            {
+                Scalar tNear = (min.data[axis] - O.data[axis]) * invD.data[axis];
+                Scalar tFar  = (max.data[axis] - O.data[axis]) * invD.data[axis];
+                if (tNear > tFar)
+                    std::swap(tNear, tFar);
+
+                // written so that NaNs (0 * inf) do not reject the box
+                t0 = tNear > t0 ? tNear : t0;
+                t1 = tFar < t1 ? tFar : t1;
+                if (t0 > t1)
+                    return false;
+            }
+            tEntry = t0;
+            return true;
+        }
+};
+
+#endif
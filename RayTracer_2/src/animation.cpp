@@ -0,0 +1,120 @@
+#include "animation.h"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using json = nlohmann::json;
+
+Animation::Animation()
+:
+    d_numFrames(1)
+{}
+
+void Animation::add(Kind kind, unsigned index, json const &node)
+{
+    json const &keys = node["keyframes"];
+    if (!keys.is_array() || keys.empty())
+        throw runtime_error("\"keyframes\" must be a non-empty array.");
+
+    for (json const &key : keys)
+        if (!key.is_object() || !key.count("frame")
+            || !key["frame"].is_number_unsigned())
+            throw runtime_error("Every keyframe needs a \"frame\" number.");
+
+    // keyframes in the order of their frames
+    Track track{kind, index, node};
+    json &sorted = track.node["keyframes"];
+    stable_sort(sorted.begin(), sorted.end(),
+                [](json const &lhs, json const &rhs)
+                {
+                    return lhs["frame"].get<unsigned>() < rhs["frame"].get<unsigned>();
+                });
+
+    d_numFrames = max(d_numFrames, sorted.back()["frame"].get<unsigned>() + 1);
+    d_tracks.push_back(track);
+}
+
+void Animation::setNumFrames(unsigned numFrames)
+{
+    d_numFrames = numFrames;
+}
+
+bool Animation::empty() const
+{
+    return d_tracks.empty();
+}
+
+unsigned Animation::numFrames() const
+{
+    return d_numFrames;
+}
+
+vector<Animation::Track> const &Animation::tracks() const
+{
+    return d_tracks;
+}
+
+json Animation::at(json const &node, unsigned frame)
+{
+    json const &keys = node["keyframes"];
+    json result = node;
+    result.erase("keyframes");
+
+    set<string> parameters;
+    for (json const &key : keys)
+        for (auto iter = key.begin(); iter != key.end(); ++iter)
+            if (iter.key() != "frame")
+                parameters.insert(iter.key());
+
+    for (string const &parameter : parameters)
+    {
+        // the keyframes of the parameter around frame
+        json const *before = nullptr;
+        json const *after = nullptr;
+        for (json const &key : keys)
+        {
+            if (!key.count(parameter))
+                continue;
+            if (key["frame"].get<unsigned>() <= frame)
+                before = &key;
+            else if (after == nullptr)
+                after = &key;
+        }
+
+        if (before == nullptr)
+            result[parameter] = (*after)[parameter];
+        else if (after == nullptr)
+            result[parameter] = (*before)[parameter];
+        else
+        {
+            double from = (*before)["frame"].get<unsigned>();
+            double to = (*after)["frame"].get<unsigned>();
+            result[parameter] = interpolate((*before)[parameter],
+                                            (*after)[parameter],
+                                            (frame - from) / (to - from));
+        }
+    }
+    return result;
+}
+
+// --- Private -----------------------------------------------------------------
+
+json Animation::interpolate(json const &before, json const &after, double t)
+{
+    // (1 - t) a + t b gives exactly a and b at the keyframes
+    if (before.is_number() && after.is_number())
+        return (1 - t) * before.get<double>() + t * after.get<double>();
+
+    if (before.is_array() && after.is_array() && before.size() == after.size())
+    {
+        json result = json::array();
+        for (unsigned idx = 0; idx != before.size(); ++idx)
+            result.push_back(interpolate(before[idx], after[idx], t));
+        return result;
+    }
+
+    return before;
+}
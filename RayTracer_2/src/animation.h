@@ -0,0 +1,63 @@
+#ifndef ANIMATION_H_
+#define ANIMATION_H_
+
+#include "json/json.h"
+
+#include <vector>
+
+// The keyframed objects, lights and camera of a scene. A node of the scene
+// file is animated by an array "keyframes" of objects, each with a "frame"
+// and values for some of the parameters of the node, e.g.
+//
+//     "keyframes": [{"frame": 0, "rotation": [0, 0, 0]},
+//                   {"frame": 48, "rotation": [0, 6.2832, 0]}]
+//
+// Between the keyframes of a parameter, numbers and arrays of numbers are
+// interpolated linearly, other values change at the keyframe. Before the
+// first and after the last keyframe of a parameter, its value is held.
+class Animation
+{
+    public:
+        enum Kind
+        {
+            OBJECT,
+            LIGHT,
+            CAMERA
+        };
+
+        struct Track
+        {
+            Kind kind;
+            unsigned index;         // of the object or light in the scene
+            nlohmann::json node;    // as read, with its keyframes
+        };
+
+    private:
+        std::vector<Track> d_tracks;
+        unsigned d_numFrames;
+
+    public:
+        Animation();
+
+        // Animate a part of the scene. Throws runtime_error if the
+        // keyframes of the node are not valid.
+        void add(Kind kind, unsigned index, nlohmann::json const &node);
+
+        // overrides the number of frames (one past the last keyframe)
+        void setNumFrames(unsigned numFrames);
+
+        bool empty() const;
+        unsigned numFrames() const;
+        std::vector<Track> const &tracks() const;
+
+        // node (as passed to add) with the values of its parameters at frame
+        static nlohmann::json at(nlohmann::json const &node, unsigned frame);
+
+    private:
+        // value between keyframes before and after with weight t of after
+        static nlohmann::json interpolate(nlohmann::json const &before,
+                                          nlohmann::json const &after,
+                                          double t);
+};
+
+#endif
@@ -0,0 +1,330 @@
+#include "benchmark.h"
+
+#include "image.h"
+
+#include "json/json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    // Silences cout while it exists: readScene and renderToFile report
+    // their progress, which is not wanted for every run.
+    class QuietCout
+    {
+        streambuf *d_buffer;
+
+        public:
+            QuietCout()
+            :
+                d_buffer(cout.rdbuf(nullptr))
+            {}
+
+            ~QuietCout()
+            {
+                cout.rdbuf(d_buffer);
+            }
+    };
+
+    // Scenes/2_reflection/1.json -> 2_reflection_1
+    string sceneName(string const &sceneFile)
+    {
+        string name = sceneFile.substr(0, sceneFile.find_last_of('.'));
+        size_t file = name.find_last_of('/');
+        if (file == string::npos)
+            return name;
+
+        size_t dir = name.find_last_of('/', file - 1);
+        dir = dir == string::npos ? 0 : dir + 1;
+        return name.substr(dir, file - dir) + '_' + name.substr(file + 1);
+    }
+
+    double raysPerSecond(unsigned long rays, double seconds)
+    {
+        return seconds > 0 ? rays / seconds : 0;
+    }
+}
+
+Benchmark::Benchmark(unsigned runs, double minPSNR)
+:
+    d_runs(max(runs, 1U)),
+    d_minPSNR(minPSNR),
+    d_threads(-1),
+    d_wavefront(false),
+    d_results()
+{}
+
+void Benchmark::setNumThreads(unsigned threads)
+{
+    d_threads = threads;
+}
+
+void Benchmark::setUseWavefront(bool use)
+{
+    d_wavefront = use;
+}
+
+bool Benchmark::run(string const &sceneFile)
+{
+    Result result;
+    result.scene = sceneFile;
+    string image = sceneName(sceneFile) + ".png";
+
+    double const inf = numeric_limits<double>::infinity();
+    Raytracer::Timings &best = result.timings;
+    best.parse = best.build = best.trace = best.encode = inf;
+    result.frames = 1;
+    result.refit = result.rebuild = inf;
+    result.rebuilds = 0;
+
+    for (unsigned run = 0; run != d_runs; ++run)
+    {
+        Raytracer raytracer;
+        Raytracer::Timings timings;
+        {
+            QuietCout quiet;
+            if (!raytracer.readScene(sceneFile))
+                return false;
+
+            if (d_threads >= 0)
+                raytracer.setNumThreads(d_threads);
+            if (d_wavefront)
+                raytracer.setUseWavefront(true);
+
+            raytracer.renderToFile(image);
+
+            // before setFrame replaces the timings of building and updating
+            timings = raytracer.getTimings();
+
+            result.frames = raytracer.numFrames();
+            if (result.frames > 1)
+            {
+                result.refit = min(result.refit, updateFrames(raytracer));
+                result.rebuilds = raytracer.getNumRebuilds();
+
+                raytracer.setRefitThreshold(-1);
+                result.rebuild = min(result.rebuild, updateFrames(raytracer));
+            }
+        }
+
+        best.parse = min(best.parse, timings.parse);
+        best.build = min(best.build, timings.build);
+        best.trace = min(best.trace, timings.trace);
+        best.encode = min(best.encode, timings.encode);
+
+        // the same in every run
+        result.stats = raytracer.getScene().getStatistics();
+    }
+
+    string reference = sceneFile.substr(0, sceneFile.find_last_of('.')) + ".png";
+    result.hasReference = ifstream(reference).good();
+    result.psnr = result.hasReference ? psnr(image, reference) : inf;
+    result.passed = !result.hasReference || result.psnr >= d_minPSNR;
+
+    d_results.push_back(result);
+    return true;
+}
+
+bool Benchmark::passed() const
+{
+    return all_of(d_results.begin(), d_results.end(),
+                  [](Result const &result) { return result.passed; });
+}
+
+void Benchmark::report(ostream &out) const
+{
+    out << "Best of " << d_runs << " run(s), times in ms:\n\n"
+        << left << setw(28) << "Scene" << right
+        << setw(8) << "parse" << setw(8) << "build" << setw(9) << "trace"
+        << setw(8) << "encode" << setw(10) << "primary" << setw(10) << "shadow"
+        << setw(10) << "second." << setw(9) << "Mrays/s" << setw(8) << "PSNR"
+        << '\n';
+
+    for (Result const &result : d_results)
+    {
+        Raytracer::Timings const &timings = result.timings;
+
+        out << left << setw(28) << sceneName(result.scene) << right
+            << fixed << setprecision(1)
+            << setw(8) << timings.parse * 1E3 << setw(8) << timings.build * 1E3
+            << setw(9) << timings.trace * 1E3 << setw(8) << timings.encode * 1E3;
+
+        // without RAY_STATISTICS the rays are not counted
+        if (Statistics::ENABLED)
+            out << setw(10) << result.stats.primary << setw(10) << result.stats.shadow
+                << setw(10) << result.stats.secondary() << setprecision(2)
+                << setw(9) << raysPerSecond(result.stats.total(), timings.trace) / 1E6;
+        else
+            out << setw(10) << '-' << setw(10) << '-' << setw(10) << '-'
+                << setw(9) << '-';
+
+        if (!result.hasReference)
+            out << setw(8) << '-';
+        else
+            out << setprecision(1) << setw(8) << result.psnr;
+
+        if (!result.passed)
+            out << "  below " << d_minPSNR << " dB";
+        out << '\n';
+    }
+
+    bool animated = any_of(d_results.begin(), d_results.end(),
+                           [](Result const &result) { return result.frames > 1; });
+    if (!animated)
+        return;
+
+    out << "\nAcceleration structure updates, ms per frame:\n\n"
+        << left << setw(28) << "Scene" << right
+        << setw(8) << "frames" << setw(8) << "refit" << setw(10) << "rebuilds"
+        << setw(9) << "rebuild" << '\n';
+
+    for (Result const &result : d_results)
+    {
+        if (result.frames == 1)
+            continue;
+
+        out << left << setw(28) << sceneName(result.scene) << right
+            << fixed << setprecision(1)
+            << setw(8) << result.frames << setw(8) << result.refit * 1E3
+            << setw(10) << result.rebuilds << setw(9) << result.rebuild * 1E3
+            << '\n';
+    }
+}
+
+void Benchmark::writeJSON(string const &filename) const
+{
+    json results = json::array();
+    for (Result const &result : d_results)
+    {
+        Raytracer::Timings const &timings = result.timings;
+        Statistics const &stats = result.stats;
+
+        json entry;
+        entry["scene"] = result.scene;
+        entry["runs"] = d_runs;
+        entry["seconds"] = {
+            {"parse", timings.parse},
+            {"build", timings.build},
+            {"trace", timings.trace},
+            {"encode", timings.encode}
+        };
+        // without RAY_STATISTICS the rays are not counted: null
+        if (Statistics::ENABLED)
+        {
+            entry["rays"] = {
+                {"primary", stats.primary},
+                {"shadow", stats.shadow},
+                {"secondary", stats.secondary()}
+            };
+            entry["rays_per_second"] = {
+                {"primary", raysPerSecond(stats.primary, timings.trace)},
+                {"shadow", raysPerSecond(stats.shadow, timings.trace)},
+                {"secondary", raysPerSecond(stats.secondary(), timings.trace)},
+                {"total", raysPerSecond(stats.total(), timings.trace)}
+            };
+        }
+        else
+            entry["rays"] = entry["rays_per_second"] = json();
+
+        // JSON has no infinity: identical images have a PSNR of null
+        if (result.hasReference)
+            entry["psnr"] = isinf(result.psnr) ? json() : json(result.psnr);
+        entry["passed"] = result.passed;
+
+        if (result.frames > 1)
+            entry["frames"] = {
+                {"count", result.frames},
+                {"refit_seconds", result.refit},
+                {"refit_rebuilds", result.rebuilds},
+                {"rebuild_seconds", result.rebuild}
+            };
+
+        results.push_back(entry);
+    }
+
+    ofstream out(filename);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing.");
+    out << setw(4) << results << '\n';
+}
+
+void Benchmark::writeCSV(string const &filename) const
+{
+    ofstream out(filename);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing.");
+
+    out << "scene,runs,parse_s,build_s,trace_s,encode_s,"
+           "primary_rays,shadow_rays,secondary_rays,rays_per_s,psnr_db,passed,"
+           "frames,refit_s,refit_rebuilds,rebuild_s\n";
+    out << setprecision(9);
+    for (Result const &result : d_results)
+    {
+        Raytracer::Timings const &timings = result.timings;
+        out << result.scene << ',' << d_runs << ','
+            << timings.parse << ',' << timings.build << ','
+            << timings.trace << ',' << timings.encode << ',';
+        if (Statistics::ENABLED)
+            out << result.stats.primary << ',' << result.stats.shadow << ','
+                << result.stats.secondary() << ','
+                << raysPerSecond(result.stats.total(), timings.trace) << ',';
+        else
+            out << ",,,,";
+        if (result.hasReference)
+            out << result.psnr;
+        out << ',' << (result.passed ? "yes" : "no") << ',' << result.frames
+            << ',';
+        if (result.frames > 1)
+            out << result.refit << ',' << result.rebuilds << ','
+                << result.rebuild;
+        else
+            out << ",,";
+        out << '\n';
+    }
+}
+
+// --- Private -----------------------------------------------------------------
+
+double Benchmark::updateFrames(Raytracer &raytracer)
+{
+    double seconds = 0;
+    for (unsigned frame = 1; frame != raytracer.numFrames(); ++frame)
+    {
+        if (!raytracer.setFrame(frame))
+            throw runtime_error("Could not set frame " + to_string(frame) + '.');
+        seconds += raytracer.getTimings().build;
+    }
+    return seconds / (raytracer.numFrames() - 1);
+}
+
+double Benchmark::psnr(string const &image, string const &reference)
+{
+    Image img(image);
+    Image ref(reference);
+    if (img.width() != ref.width() || img.height() != ref.height())
+        return 0;
+
+    // Both images come from 8 bit PNG files, so the error is on that scale.
+    double error = 0;
+    for (unsigned y = 0; y != img.height(); ++y)
+        for (unsigned x = 0; x != img.width(); ++x)
+        {
+            Color diff = img(x, y) - ref(x, y);
+            error += diff.dot(diff);
+        }
+
+    if (error == 0)
+        return numeric_limits<double>::infinity();
+
+    double mse = error / (3.0 * img.width() * img.height());
+    return 10 * log10(1 / mse);
+}
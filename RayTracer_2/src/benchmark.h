@@ -0,0 +1,77 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "raytracer.h"
+#include "statistics.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Renders scenes a number of times and records the duration of every stage
+// (the fastest of the runs), the number of rays traced by kind and the PSNR
+// of the image against the reference image next to the scene file (the
+// scene file with .png instead of .json), if there is one.
+//
+// Animated scenes are also stepped through their frames twice, to compare
+// refitting their BVHs (rebuilding them when refitting made them too slow)
+// with rebuilding them every frame.
+//
+// The images are written to the working directory, named after the scene
+// file and its directory (Scenes/2_reflection/1.json: 2_reflection_1.png).
+class Benchmark
+{
+    public:
+        struct Result
+        {
+            std::string scene;
+            Raytracer::Timings timings;
+            Statistics stats;
+            bool hasReference;
+            double psnr;        // in dB, infinite if identical
+            bool passed;        // no reference, or psnr >= the threshold
+
+            // animated scenes: seconds per frame updating the acceleration
+            // structures by refitting and by rebuilding, and the BVHs the
+            // refit threshold rebuilt over all frames
+            unsigned frames;
+            double refit;
+            double rebuild;
+            unsigned rebuilds;
+        };
+
+    private:
+        unsigned d_runs;
+        double d_minPSNR;
+        int d_threads;          // -1: as specified by the scene
+        bool d_wavefront;
+        std::vector<Result> d_results;
+
+    public:
+        Benchmark(unsigned runs, double minPSNR);
+
+        void setNumThreads(unsigned threads);
+        void setUseWavefront(bool use);
+
+        // Benchmark a scene, false if it could not be read
+        bool run(std::string const &sceneFile);
+
+        // true if all scenes rendered within the PSNR threshold
+        bool passed() const;
+
+        // a table of the results
+        void report(std::ostream &out) const;
+
+        void writeJSON(std::string const &filename) const;
+        void writeCSV(std::string const &filename) const;
+
+    private:
+        // Step raytracer through frames 1 to the last, returns the seconds
+        // per frame of updating the acceleration structures
+        static double updateFrames(Raytracer &raytracer);
+
+        // PSNR of two images of the same size, infinite if identical
+        static double psnr(std::string const &image, std::string const &reference);
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+using namespace std;
+
+namespace
+{
+    unsigned const NUM_BINS = 12;
+    unsigned const MAX_LEAF_SIZE = 4;
+
+    // Beyond this depth nodes are split at the median, which bounds the
+    // depth of the tree (and thereby the traversal stack) to 32 + log2(n).
+    unsigned const MAX_SAH_DEPTH = 32;
+
+    // cost of entering an interior node relative to testing a primitive,
+    // for BVH::cost
+    Scalar const TRAVERSAL_COST = 1;
+
+    struct Bin
+    {
+        AABB box;
+        unsigned count = 0;
+    };
+}
+
+void BVH::build(vector<AABB> const &boxes)
+{
+    clear();
+    if (boxes.empty())
+        return;
+
+    vector<Point> centroids;
+    centroids.reserve(boxes.size());
+    for (AABB const &box : boxes)
+        centroids.push_back(box.center());
+
+    d_indices.resize(boxes.size());
+    iota(d_indices.begin(), d_indices.end(), 0U);
+
+    // a binary tree with n leaves has 2n - 1 nodes
+    d_nodes.reserve(2 * boxes.size() - 1);
+    buildNode(boxes, centroids, 0, boxes.size(), 0);
+    d_builtCost = cost();
+}
+
+void BVH::clear()
+{
+    d_nodes.clear();
+    d_indices.clear();
+}
+
+void BVH::refit(vector<AABB> const &boxes)
+{
+    // Children follow their parent in d_nodes
+    for (unsigned nodeIdx = d_nodes.size(); nodeIdx-- != 0; )
+    {
+        Node &node = d_nodes[nodeIdx];
+        AABB bounds;
+        if (node.count > 0)
+        {
+            for (unsigned idx = node.offset; idx != node.offset + node.count; ++idx)
+                bounds.extend(boxes[d_indices[idx]]);
+        }
+        else
+        {
+            bounds.extend(d_nodes[nodeIdx + 1].box);
+            bounds.extend(d_nodes[node.offset].box);
+        }
+        node.box = bounds;
+    }
+}
+
+bool BVH::update(vector<AABB> const &boxes, Scalar maxGrowth)
+{
+    if (maxGrowth < 0 || boxes.size() != d_indices.size())
+    {
+        build(boxes);
+        return true;
+    }
+
+    refit(boxes);
+    if (cost() <= (1 + maxGrowth) * d_builtCost)
+        return false;
+
+    build(boxes);
+    return true;
+}
+
+Scalar BVH::cost() const
+{
+    if (d_nodes.empty())
+        return 0;
+
+    // A ray through the root box enters a node with the ratio of the areas
+    // of the node and the root box.
+    Scalar rootArea = d_nodes[0].box.surfaceArea();
+    if (rootArea == 0.0)
+        return d_indices.size();
+
+    Scalar cost = 0;
+    for (Node const &node : d_nodes)
+    {
+        Scalar nodeCost = node.count > 0 ? node.count : TRAVERSAL_COST;
+        cost += nodeCost * node.box.surfaceArea();
+    }
+    return cost / rootArea;
+}
+
+bool BVH::empty() const
+{
+    return d_nodes.empty();
+}
+
+unsigned BVH::numNodes() const
+{
+    return d_nodes.size();
+}
+
+unsigned BVH::buildNode(vector<AABB> const &boxes,
+                        vector<Point> const &centroids,
+                        unsigned begin, unsigned end, unsigned depth)
+{
+    unsigned nodeIdx = d_nodes.size();
+    d_nodes.push_back(Node());
+
+    AABB bounds;
+    AABB centroidBounds;
+    for (unsigned idx = begin; idx != end; ++idx)
+    {
+        bounds.extend(boxes[d_indices[idx]]);
+        centroidBounds.extend(centroids[d_indices[idx]]);
+    }
+    d_nodes[nodeIdx].box = bounds;
+
+    unsigned count = end - begin;
+    if (count <= MAX_LEAF_SIZE)
+    {
+        d_nodes[nodeIdx].offset = begin;
+        d_nodes[nodeIdx].count = count;
+        return nodeIdx;
+    }
+
+    // Split along the axis with the largest centroid extent.
+    Vector extent = centroidBounds.max - centroidBounds.min;
+    unsigned axis = 0;
+    if (extent.y > extent.data[axis])
+        axis = 1;
+    if (extent.z > extent.data[axis])
+        axis = 2;
+
+    auto first = d_indices.begin() + begin;
+    auto last = d_indices.begin() + end;
+    unsigned mid;
+
+    if (depth < MAX_SAH_DEPTH && extent.data[axis] > 0.0)
+    {
+        // Bin the centroids and evaluate the SAH at each bin boundary.
+        // The first and last bin are never empty, so a split always exists.
+        Scalar minC = centroidBounds.min.data[axis];
+        Scalar scale = NUM_BINS / extent.data[axis];
+        auto binOf = [&](unsigned prim)
+        {
+            unsigned bin = static_cast<unsigned>(
+                (centroids[prim].data[axis] - minC) * scale);
+            return min(bin, NUM_BINS - 1);
+        };
+
+        Bin bins[NUM_BINS];
+        for (unsigned idx = begin; idx != end; ++idx)
+        {
+            Bin &bin = bins[binOf(d_indices[idx])];
+            bin.box.extend(boxes[d_indices[idx]]);
+            ++bin.count;
+        }
+
+        // sweep from the right to get the area and count right of each split
+        Scalar rightArea[NUM_BINS];
+        unsigned rightCount[NUM_BINS];
+        AABB rightBox;
+        unsigned rightSum = 0;
+        for (unsigned split = NUM_BINS - 1; split != 0; --split)
+        {
+            rightBox.extend(bins[split].box);
+            rightSum += bins[split].count;
+            rightArea[split] = rightBox.surfaceArea();
+            rightCount[split] = rightSum;
+        }
+
+        Scalar bestCost = numeric_limits<Scalar>::infinity();
+        unsigned bestSplit = 1;
+        AABB leftBox;
+        unsigned leftSum = 0;
+        for (unsigned split = 1; split != NUM_BINS; ++split)
+        {
+            leftBox.extend(bins[split - 1].box);
+            leftSum += bins[split - 1].count;
+            if (leftSum == 0 || rightCount[split] == 0)
+                continue;
+
+            Scalar cost = leftBox.surfaceArea() * leftSum
+                        + rightArea[split] * rightCount[split];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = split;
+            }
+        }
+
+        mid = partition(first, last, [&](unsigned prim)
+        {
+            return binOf(prim) < bestSplit;
+        }) - d_indices.begin();
+    }
+    else
+    {
+        // median split, also used when all centroids coincide
+        mid = begin + count / 2;
+        nth_element(first, d_indices.begin() + mid, last,
+            [&](unsigned lhs, unsigned rhs)
+            {
+                return centroids[lhs].data[axis] < centroids[rhs].data[axis];
+            });
+    }
+
+    buildNode(boxes, centroids, begin, mid, depth + 1);
+    d_nodes[nodeIdx].offset = buildNode(boxes, centroids, mid, end, depth + 1);
+    d_nodes[nodeIdx].count = 0;
+    return nodeIdx;
+}
@@ -0,0 +1,146 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include "aabb.h"
+#include "ray.h"
+
+#include <vector>
+
+// Bounding volume hierarchy over a set of primitives which are only known
+// by their bounding boxes. The tree is built with a binned surface area
+// heuristic and stored flattened in depth-first order: the left child of an
+// interior node directly follows it, the index of the right child is stored.
+//
+// Primitives are referred to by their index in the vector of boxes passed to
+// build(); what such an index means is up to the user of the BVH.
+class BVH
+{
+    public:
+        struct Node
+        {
+            AABB box;
+            unsigned offset;    // leaf: first entry in d_indices
+                                // interior: index of the right child
+            unsigned count;     // number of primitives, 0 for interior nodes
+        };
+
+    private:
+        std::vector<Node> d_nodes;
+        std::vector<unsigned> d_indices;
+        Scalar d_builtCost = 0;     // cost() right after the last build
+
+    public:
+        void build(std::vector<AABB> const &boxes);
+        void clear();
+
+        // Update the node boxes, bottom-up, to new boxes of the same
+        // primitives, keeping the tree. Much faster than build, but the
+        // tree gets worse as the primitives move further.
+        void refit(std::vector<AABB> const &boxes);
+
+        // Refit to the new boxes, unless that makes the tree cost more than
+        // 1 + maxGrowth times its cost after it was built: then build it
+        // anew. A negative maxGrowth always builds. Returns whether the
+        // tree was built anew.
+        bool update(std::vector<AABB> const &boxes, Scalar maxGrowth);
+
+        // Expected cost of a ray through the root box by the surface area
+        // heuristic: the interior nodes it enters and the primitives in the
+        // leaves it enters.
+        Scalar cost() const;
+
+        bool empty() const;
+        unsigned numNodes() const;
+
+        // Visit all primitives whose bounding box is entered by the ray
+        // before tMax, closest nodes first. The visitor is called as
+        // visit(index, tMax) and may shrink tMax to cull further nodes.
+        // Returning true from the visitor ends the traversal.
+        // Returns the number of node bounding boxes tested.
+        template <typename Visitor>
+        unsigned traverse(Ray const &ray, Scalar &tMax, Visitor &&visit) const;
+
+    private:
+        unsigned buildNode(std::vector<AABB> const &boxes,
+                           std::vector<Point> const &centroids,
+                           unsigned begin, unsigned end, unsigned depth);
+};
+
+template <typename Visitor>
+unsigned BVH::traverse(Ray const &ray, Scalar &tMax, Visitor &&visit) const
+{
+    if (d_nodes.empty())
+        return 0;
+
+    Vector invD(1.0 / ray.D.x, 1.0 / ray.D.y, 1.0 / ray.D.z);
+
+    unsigned boxTests = 1;
+    Scalar tEntry;
+    if (!d_nodes[0].box.intersect(ray.O, invD, tMax, tEntry))
+        return boxTests;
+
+    // Stack of nodes still to be visited, with their entry distances.
+    // The tree depth is bounded by the build, 64 is plenty.
+    unsigned stack[64];
+    Scalar entry[64];
+    unsigned top = 0;
+
+    unsigned current = 0;
+    while (true)
+    {
+        Node const &node = d_nodes[current];
+        if (node.count > 0)
+        {
+            for (unsigned idx = 0; idx != node.count; ++idx)
+                if (visit(d_indices[node.offset + idx], tMax))
+                    return boxTests;
+        }
+        else
+        {
+            unsigned left = current + 1;
+            unsigned right = node.offset;
+            Scalar tLeft;
+            Scalar tRight;
+            boxTests += 2;
+            bool hitLeft = d_nodes[left].box.intersect(ray.O, invD, tMax, tLeft);
+            bool hitRight = d_nodes[right].box.intersect(ray.O, invD, tMax, tRight);
+
+            if (hitLeft && hitRight)
+            {
+                // descend into the closest child, postpone the other
+                if (tRight < tLeft)
+                {
+                    std::swap(left, right);
+                    std::swap(tLeft, tRight);
+                }
+                stack[top] = right;
+                entry[top] = tRight;
+                ++top;
+                current = left;
+                continue;
+            }
+            if (hitLeft)
+            {
+                current = left;
+                continue;
+            }
+            if (hitRight)
+            {
+                current = right;
+                continue;
+            }
+        }
+
+        // pop the next node which can still contain a closer hit
+        do
+        {
+            if (top == 0)
+                return boxTests;
+            --top;
+        }
+        while (entry[top] > tMax);
+        current = stack[top];
+    }
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "camera.h"
+
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+Camera::Camera()
+:
+    d_eye(),
+    d_width(400),
+    d_height(400),
+    d_center(),
+    d_up(),
+    d_fov(0)
+{
+    update();
+}
+
+void Camera::setEye(Point const &eye)
+{
+    d_eye = eye;
+    update();
+}
+
+void Camera::lookAt(Point const &eye, Point const &center, Vector const &up,
+                    Scalar fov)
+{
+    if ((center - eye).cross(up).length_2() == 0)
+        throw runtime_error("The up vector of the camera is parallel to its "
+                            "viewing direction.");
+    if (!(fov > 0 && fov < 180))
+        throw runtime_error("The field of view of the camera must be between "
+                            "0 and 180 degrees.");
+
+    d_eye = eye;
+    d_center = center;
+    d_up = up;
+    d_fov = fov;
+    update();
+}
+
+void Camera::setSize(unsigned width, unsigned height)
+{
+    d_width = width;
+    d_height = height;
+    update();
+}
+
+Point const &Camera::eye() const
+{
+    return d_eye;
+}
+
+unsigned Camera::width() const
+{
+    return d_width;
+}
+
+unsigned Camera::height() const
+{
+    return d_height;
+}
+
+Vector Camera::direction(Scalar x, Scalar y) const
+{
+    return (d_origin + x * d_dx + y * d_dy - d_eye).normalized();
+}
+
+// --- Private -----------------------------------------------------------------
+
+void Camera::update()
+{
+    if (d_fov == 0)
+    {
+        // The plane z = 0: these exact vectors give the same directions as
+        // (Point(x, y, 0) - eye).normalized().
+        d_origin = Point(0, 0, 0);
+        d_dx = Vector(1, 0, 0);
+        d_dy = Vector(0, 1, 0);
+        return;
+    }
+
+    // The screen at distance 1 in front of the eye, centered on the viewing
+    // direction, with square pixels.
+    Vector forward = (d_center - d_eye).normalized();
+    Vector right = forward.cross(d_up).normalized();
+    Vector up = right.cross(forward);
+    Scalar pixelSize = 2 * tan(d_fov * M_PI / 360) / d_height;
+
+    d_dx = pixelSize * right;
+    d_dy = pixelSize * up;
+    d_origin = d_eye + forward - d_width / 2.0 * d_dx - d_height / 2.0 * d_dy;
+}
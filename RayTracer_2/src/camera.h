@@ -0,0 +1,59 @@
+#ifndef CAMERA_H_
+#define CAMERA_H_
+
+#include "triple.h"
+
+// Pinhole camera, maps points on the screen to the directions of camera
+// rays. Screen coordinates are in pixels of the image of the camera, with
+// the origin at its bottom left corner and y pointing up: the center of the
+// top left pixel is (0.5, height - 0.5).
+//
+// By default the screen is the plane z = 0 with one world unit per pixel,
+// seen from the eye, as in scenes which only give an "Eye". A camera set
+// with lookAt looks from its eye at a center point instead, with a vertical
+// field of view independent of the resolution.
+class Camera
+{
+    Point d_eye;
+    unsigned d_width;
+    unsigned d_height;
+
+    // view of lookAt, d_fov == 0 for the plane z = 0
+    Point d_center;
+    Vector d_up;
+    Scalar d_fov;
+
+    // The screen point (x, y) is at d_origin + x * d_dx + y * d_dy.
+    Point d_origin;
+    Vector d_dx;
+    Vector d_dy;
+
+    public:
+        // eye at the origin, 400 x 400 pixels
+        Camera();
+
+        // moves the eye, keeping the screen of a camera without lookAt
+        void setEye(Point const &eye);
+
+        // Look from eye at center, with up pointing up in the image and a
+        // vertical field of view of fov degrees. Throws runtime_error if
+        // up is parallel to the viewing direction.
+        void lookAt(Point const &eye, Point const &center, Vector const &up,
+                    Scalar fov);
+
+        // size of the image in pixels
+        void setSize(unsigned width, unsigned height);
+
+        Point const &eye() const;
+        unsigned width() const;
+        unsigned height() const;
+
+        // normalized direction of the camera ray through screen point (x, y)
+        Vector direction(Scalar x, Scalar y) const;
+
+    private:
+        // compute d_origin, d_dx and d_dy from the view and the size
+        void update();
+};
+
+#endif
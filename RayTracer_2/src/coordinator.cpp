@@ -0,0 +1,250 @@
+#include "coordinator.h"
+
+#include "image.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+Coordinator::Coordinator(string const &program, unsigned numWorkers,
+                         unsigned tileSize)
+:
+    d_program(program),
+    d_numWorkers(max(numWorkers, 1U)),
+    d_tileSize(max(tileSize, 1U)),
+    d_timeout(0)
+{}
+
+void Coordinator::addOption(string const &option)
+{
+    d_options.push_back(option);
+}
+
+void Coordinator::setTimeout(double seconds)
+{
+    d_timeout = seconds;
+}
+
+void Coordinator::render(string const &sceneFile, string const &outFile,
+                         Image &img, unsigned x0, unsigned y0)
+{
+    vector<char> dir(outFile.begin(), outFile.end());
+    string const suffix = ".tiles.XXXXXX";
+    dir.insert(dir.end(), suffix.begin(), suffix.end());
+    dir.push_back('\0');
+    if (mkdtemp(dir.data()) == nullptr)
+        throw runtime_error("Could not create a directory for the tiles of "
+                            + outFile + '.');
+    d_tileDir = dir.data();
+
+    deque<Job> queue;
+    for (unsigned y = 0; y < img.height(); y += d_tileSize)
+        for (unsigned x = 0; x < img.width(); x += d_tileSize)
+        {
+            TileScheduler::Tile tile{x, y, min(x + d_tileSize, img.width()),
+                                     min(y + d_tileSize, img.height())};
+            queue.push_back(Job{tile, 0, 0, {}});
+        }
+
+    unsigned numTiles = queue.size();
+    unsigned done = 0;
+    vector<Job> running;
+    try
+    {
+        while (!queue.empty() || !running.empty())
+        {
+            while (!queue.empty() && running.size() < d_numWorkers)
+            {
+                Job job = queue.front();
+                queue.pop_front();
+                ++job.attempts;
+                job.pid = launch(sceneFile, job, x0, y0);
+                job.start = chrono::steady_clock::now();
+                running.push_back(job);
+            }
+
+            // Poll, so that hanging workers can be found
+            int status;
+            pid_t pid = waitpid(-1, &status, WNOHANG);
+            if (pid < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw runtime_error("Lost track of the workers.");
+            }
+
+            string error;
+            auto iter = running.end();
+            if (pid == 0)
+            {
+                iter = find_if(running.begin(), running.end(),
+                               [&](Job const &job) { return timedOut(job); });
+                if (iter == running.end())
+                {
+                    this_thread::sleep_for(chrono::milliseconds(10));
+                    continue;
+                }
+                kill(iter->pid, SIGKILL);
+                waitpid(iter->pid, nullptr, 0);
+                ostringstream reason;
+                reason << "no result after " << d_timeout << " s";
+                error = reason.str();
+            }
+            else
+            {
+                iter = find_if(running.begin(), running.end(),
+                               [&](Job const &job) { return job.pid == pid; });
+                if (iter == running.end())
+                    continue;
+                error = collect(*iter, status, img);
+            }
+            Job job = *iter;
+            running.erase(iter);
+
+            TileScheduler::Tile const &tile = job.tile;
+            if (error.empty())
+            {
+                ++done;
+                cout << "Tile " << done << " of " << numTiles << " done.\n";
+                continue;
+            }
+
+            cerr << "Warning: the worker for pixels " << x0 + tile.x0 << ','
+                 << y0 + tile.y0 << " to " << x0 + tile.x1 << ','
+                 << y0 + tile.y1 << " failed (" << error << ", attempt "
+                 << job.attempts << " of " << MAX_ATTEMPTS << ").\n";
+
+            if (job.attempts == MAX_ATTEMPTS)
+            {
+                ifstream log(tileFile(job, ".log"));
+                string output{istreambuf_iterator<char>(log),
+                              istreambuf_iterator<char>()};
+                if (!output.empty())
+                    cerr << "Output of the worker:\n" << output;
+                throw runtime_error("Rendering the tile failed "
+                                    + to_string(MAX_ATTEMPTS) + " times.");
+            }
+            queue.push_back(job);
+        }
+    }
+    catch (...)
+    {
+        for (Job const &job : running)
+        {
+            kill(job.pid, SIGTERM);
+            waitpid(job.pid, nullptr, 0);
+        }
+        removeTileDir();
+        throw;
+    }
+
+    removeTileDir();
+}
+
+// --- Private -----------------------------------------------------------------
+
+pid_t Coordinator::launch(string const &sceneFile, Job const &job,
+                          unsigned x0, unsigned y0) const
+{
+    TileScheduler::Tile const &tile = job.tile;
+    ostringstream region;
+    region << x0 + tile.x0 << ',' << y0 + tile.y0 << ','
+           << x0 + tile.x1 << ',' << y0 + tile.y1;
+
+    vector<string> args{d_program};
+    args.insert(args.end(), d_options.begin(), d_options.end());
+    args.insert(args.end(), {"--region", region.str(), sceneFile,
+                             tileFile(job, ".png")});
+
+    vector<char *> argv;
+    for (string &arg : args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    string log = tileFile(job, ".log");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        throw runtime_error("Could not start a worker.");
+
+    if (pid == 0)
+    {
+        // The worker: its output goes to the log of the tile
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0)
+        {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execvp(argv[0], argv.data());
+        perror(argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+string Coordinator::collect(Job const &job, int status, Image &img) const
+{
+    if (WIFSIGNALED(status))
+        return "killed by signal " + to_string(WTERMSIG(status));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return "exit status " + to_string(WEXITSTATUS(status));
+
+    TileScheduler::Tile const &tile = job.tile;
+    string file = tileFile(job, ".png");
+    Image result(file);
+    if (result.width() != tile.x1 - tile.x0
+        || result.height() != tile.y1 - tile.y0)
+        return "no tile in " + file;
+
+    for (unsigned y = tile.y0; y != tile.y1; ++y)
+        for (unsigned x = tile.x0; x != tile.x1; ++x)
+            img(x, y) = result(x - tile.x0, y - tile.y0);
+
+    remove(file.c_str());
+    remove(tileFile(job, ".log").c_str());
+    return "";
+}
+
+bool Coordinator::timedOut(Job const &job) const
+{
+    chrono::duration<double> running = chrono::steady_clock::now() - job.start;
+    return d_timeout > 0 && running.count() > d_timeout;
+}
+
+string Coordinator::tileFile(Job const &job, char const *extension) const
+{
+    return d_tileDir + '/' + to_string(job.tile.x0) + '_'
+           + to_string(job.tile.y0) + extension;
+}
+
+void Coordinator::removeTileDir() const
+{
+    if (DIR *dir = opendir(d_tileDir.c_str()))
+    {
+        while (dirent *entry = readdir(dir))
+        {
+            string name = entry->d_name;
+            if (name != "." && name != "..")
+                remove((d_tileDir + '/' + name).c_str());
+        }
+        closedir(dir);
+    }
+    rmdir(d_tileDir.c_str());
+}
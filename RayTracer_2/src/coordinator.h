@@ -0,0 +1,78 @@
+#ifndef COORDINATOR_H_
+#define COORDINATOR_H_
+
+#include "tilescheduler.h"
+
+#include <chrono>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+class Image;
+
+// Renders an image with worker processes. The image is split into tiles,
+// and for every tile the ray tracer is started with --region, at most
+// numWorkers at a time. Workers write their tile as a PNG file to a
+// temporary directory next to the output file, from where it is pasted
+// into the image. Workers render exactly the pixels they would in a single
+// process, so the image is the same.
+//
+// A tile whose worker fails (or leaves no readable tile) is queued again,
+// up to MAX_ATTEMPTS times. So is the tile of a worker still running after
+// the timeout (see setTimeout), which is killed: it may hang forever.
+class Coordinator
+{
+    public:
+        static unsigned const MAX_ATTEMPTS = 3;
+
+    private:
+        struct Job
+        {
+            TileScheduler::Tile tile;   // in the image rendered
+            unsigned attempts;
+            pid_t pid;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        std::string d_program;              // the ray tracer to run
+        std::vector<std::string> d_options; // passed to every worker
+        unsigned d_numWorkers;
+        unsigned d_tileSize;
+        double d_timeout;                   // seconds, 0: none
+        std::string d_tileDir;
+
+    public:
+        Coordinator(std::string const &program, unsigned numWorkers,
+                    unsigned tileSize);
+
+        // pass option to every worker (e.g. --size or --threads)
+        void addOption(std::string const &option);
+
+        // kill workers running longer than seconds (0: wait forever)
+        void setTimeout(double seconds);
+
+        // Render sceneFile into img, which is the region of the image of
+        // the camera with top left pixel (x0, y0). The tiles are written
+        // to a directory next to outFile. Throws runtime_error if a tile
+        // fails MAX_ATTEMPTS times or no worker can be started.
+        void render(std::string const &sceneFile, std::string const &outFile,
+                    Image &img, unsigned x0 = 0, unsigned y0 = 0);
+
+    private:
+        // start a worker for job, returns its pid
+        pid_t launch(std::string const &sceneFile, Job const &job,
+                     unsigned x0, unsigned y0) const;
+
+        // Paste the tile of a worker which exited with status into img.
+        // Returns the reason of the failure, empty on success.
+        std::string collect(Job const &job, int status, Image &img) const;
+
+        bool timedOut(Job const &job) const;
+
+        std::string tileFile(Job const &job, char const *extension) const;
+
+        // remove the tile directory and the files left in it
+        void removeTileDir() const;
+};
+
+#endif
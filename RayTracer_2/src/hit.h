@@ -7,21 +7,23 @@
 class Hit
 {
     public:
-        double t;   // distance of hit
-        Vector N;   // Normal at hit
+        Scalar t;       // distance of hit
+        Vector N;       // Normal at hit
+        unsigned part;  // part of the object hit (the triangle of a mesh)
 
-        Hit(double time, Vector const &normal)
+        Hit(Scalar time, Vector const &normal, unsigned part = 0)
         :
             t(time),
-            N(normal)
+            N(normal),
+            part(part)
         {}
 
         static Hit const NO_HIT()
         {
-            static Hit no_hit(std::numeric_limits<double>::quiet_NaN(),
-                              Vector(std::numeric_limits<double>::quiet_NaN(),
-                                     std::numeric_limits<double>::quiet_NaN(),
-                                     std::numeric_limits<double>::quiet_NaN()));
+            static Hit no_hit(std::numeric_limits<Scalar>::quiet_NaN(),
+                              Vector(std::numeric_limits<Scalar>::quiet_NaN(),
+                                     std::numeric_limits<Scalar>::quiet_NaN(),
+                                     std::numeric_limits<Scalar>::quiet_NaN()));
             return no_hit;
         }
 };
@@ -0,0 +1,30 @@
+#ifndef HITRECORD_H_
+#define HITRECORD_H_
+
+#include "triple.h"
+
+#include <limits>
+
+// Result of Scene::castRay. The primitive hit is identified by the index of
+// its object in the scene, so a hit record is plain data: producing and
+// copying it involves no reference counting or heap allocation.
+class HitRecord
+{
+    public:
+        // prim of a ray that hits nothing
+        static unsigned const NONE = std::numeric_limits<unsigned>::max();
+
+        unsigned prim;  // index of the object hit, NONE on a miss
+        Scalar t;       // distance of hit (infinity on a miss)
+        Vector N;       // normal at hit, pointing out of closed objects
+        unsigned part;  // part of the object hit (see Hit)
+        Vector uv;      // texture coordinates at hit (x: u, y: v), only
+                        // computed for textured materials
+
+        bool isHit() const
+        {
+            return prim != NONE;
+        }
+};
+
+#endif
@@ -14,6 +14,9 @@ Image::Image(unsigned width, unsigned height)
 {}
 
 Image::Image(string const &filename)
+:
+    d_width(0),
+    d_height(0)
 {
     read_png(filename);
 }
@@ -80,7 +83,12 @@ void Image::write_png(std::string const &filename) const
 void Image::read_png(std::string const &filename)
 {
     vector<unsigned char> image;
-    lodepng::decode(image, d_width, d_height, filename);
+    d_pixels.clear();
+    if (lodepng::decode(image, d_width, d_height, filename) != 0)
+    {
+        d_width = d_height = 0;     // unreadable: an empty image
+        return;
+    }
     d_pixels.reserve(size());
 
     auto imgIter = image.begin();
@@ -35,6 +35,7 @@ class Image
         Color const &colorAt(float x, float y) const;
 
         void write_png(std::string const &filename) const;
+        // the image is empty if the file cannot be read
         void read_png(std::string const &filename);
 
     private:
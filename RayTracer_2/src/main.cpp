@@ -1,43 +1,417 @@
+#include "benchmark.h"
+#include "coordinator.h"
+#include "image.h"
 #include "raytracer.h"
 
+#include <chrono>
+#include <exception>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 using namespace std;
 
+namespace
+{
+    void usage(char const *program)
+    {
+        cerr << "Usage: " << program << " [options] in-file [out-file.png]\n"
+                "       " << program << " --bench [options] in-file...\n"
+                "Options:\n"
+                "  --threads N    render on N threads (0: all hardware threads)\n"
+                "  --wavefront    trace rays stage by stage instead of recursively\n"
+                "  --size WxH     render an image of W x H pixels\n"
+                "  --region X0,Y0,X1,Y1\n"
+                "                 only render columns X0 up to X1 and rows Y0 up to Y1\n"
+                "                 (counted from the top) of the image\n"
+                "  --sample-counts FILE.png\n"
+                "                 write the number of samples per pixel to FILE.png\n"
+                "  --stats FILE.json\n"
+                "                 write ray and intersection statistics to FILE.json\n"
+                "  --progressive  render in refinement passes, writing a snapshot of\n"
+                "                 the image to the output file every 10 seconds\n"
+                "  --snapshot-interval S\n"
+                "                 write snapshots every S seconds (implies --progressive)\n"
+                "  --state FILE   save the progressive render to FILE with every snapshot\n"
+                "                 and resume from FILE if it exists (implies --progressive)\n"
+                "  --sequence     render all frames of an animated scene, to the output\n"
+                "                 file with #### replaced by the frame number (or with\n"
+                "                 _0000 etc. appended to its name)\n"
+                "  --frames A,B   render frames A up to and including B (implies\n"
+                "                 --sequence)\n"
+                "  --workers N    render tiles of the image in N worker processes\n"
+                "                 (with --threads 1, unless --threads is given)\n"
+                "  --worker-tile-size S\n"
+                "                 size of the tiles of the workers (default 64)\n"
+                "  --worker-timeout S\n"
+                "                 kill a worker after S seconds and render its tile\n"
+                "                 again (default 0: no timeout)\n"
+                "Benchmark options:\n"
+                "  --runs N       render every scene N times (default 3)\n"
+                "  --json FILE    write the results to FILE as JSON\n"
+                "  --csv FILE     write the results to FILE as CSV\n"
+                "  --min-psnr DB  fail if an image's PSNR against its reference is\n"
+                "                 below DB dB (default 40)\n";
+    }
+
+    // The number text, which must be digits only and at most max.
+    // Throws invalid_argument otherwise (stoul accepts "-1", which wraps).
+    unsigned parseUnsigned(string const &text,
+                           unsigned max = numeric_limits<unsigned>::max())
+    {
+        if (text.empty() || text.find_first_not_of("0123456789") != string::npos)
+            throw invalid_argument("\"" + text + "\" is not a number");
+
+        unsigned long number = stoul(text);     // throws out_of_range
+        if (number > max)
+            throw invalid_argument(text + " is larger than " + to_string(max));
+        return number;
+    }
+
+    // the numbers in text, separated by sep
+    vector<unsigned> parseList(string const &text, char sep)
+    {
+        vector<unsigned> numbers;
+        size_t pos = 0;
+        while (true)
+        {
+            size_t end = text.find(sep, pos);
+            numbers.push_back(parseUnsigned(text.substr(pos, end - pos)));
+            if (end == string::npos)
+                return numbers;
+            pos = end + 1;
+        }
+    }
+
+    // the output file of frame: ofname with its run of #'s replaced by the
+    // frame number, or with the frame number appended to its name
+    string frameFile(string ofname, unsigned frame)
+    {
+        size_t begin = ofname.find('#');
+        size_t end = ofname.find_first_not_of('#', begin);
+        if (begin == string::npos)
+        {
+            begin = end = ofname.find_last_of('.');
+            if (begin == string::npos || ofname.find('/', begin) != string::npos)
+                begin = end = ofname.size();
+            ofname.insert(begin, "_####");
+            ++begin;
+            end = begin + 4;
+        }
+        if (end == string::npos)
+            end = ofname.size();
+
+        string number = to_string(frame);
+        if (number.size() < end - begin)
+            number.insert(0, end - begin - number.size(), '0');
+        return ofname.replace(begin, end - begin, number);
+    }
+
+    // Render frames first up to last of the scene read by raytracer,
+    // returns the exit code of the program
+    int renderSequence(Raytracer &raytracer, string const &ofname,
+                       unsigned first, unsigned last)
+    {
+        auto start = chrono::steady_clock::now();
+        Raytracer::Timings total;
+        for (unsigned frame = first; frame <= last; ++frame)
+        {
+            cout << "\nFrame " << frame << " (" << frame - first + 1 << " of "
+                 << last - first + 1 << ")\n";
+
+            // readScene leaves the scene at frame 0
+            if (frame != 0 && !raytracer.setFrame(frame))
+            {
+                cerr << "Error: could not move the scene to frame " << frame
+                     << ".\n";
+                return 1;
+            }
+            raytracer.renderToFile(frameFile(ofname, frame));
+
+            Raytracer::Timings const &timings = raytracer.getTimings();
+            total.update += timings.update;
+            total.build += timings.build;
+            total.trace += timings.trace;
+            total.encode += timings.encode;
+        }
+
+        double seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+        cout << "\nRendered " << last - first + 1 << " frames in " << seconds
+             << " s: " << total.update << " s updating the scene, "
+             << total.build << " s building the BVH, " << total.trace
+             << " s tracing, " << total.encode << " s writing images.\n";
+        return 0;
+    }
+
+    // Render with worker processes (see coordinator.h), returns the exit
+    // code of the program
+    int distribute(string const &program, Raytracer const &raytracer,
+                   string const &sceneFile, string const &ofname,
+                   unsigned workers, unsigned tileSize, double timeout,
+                   vector<unsigned> const &region, int threads, bool wavefront)
+    try
+    {
+        Camera const &camera = raytracer.getScene().getCamera();
+        vector<unsigned> window{0, 0, camera.width(), camera.height()};
+        if (!region.empty())
+            window = region;
+
+        Coordinator coordinator(program, workers, tileSize);
+        coordinator.setTimeout(timeout);
+        coordinator.addOption("--size");
+        coordinator.addOption(to_string(camera.width()) + 'x'
+                              + to_string(camera.height()));
+        coordinator.addOption("--threads");
+        coordinator.addOption(to_string(threads >= 0 ? threads : 1));
+        if (wavefront)
+            coordinator.addOption("--wavefront");
+
+        Image img(window[2] - window[0], window[3] - window[1]);
+        cout << "Tracing " << img.width() << " x " << img.height()
+             << " pixels on " << workers << " workers...\n";
+        coordinator.render(sceneFile, ofname, img, window[0], window[1]);
+
+        cout << "Writing image to " << ofname << "...\n";
+        img.write_png(ofname);
+        cout << "Done.\n";
+        return 0;
+    }
+    catch (exception const &ex)
+    {
+        cerr << "Error: " << ex.what() << '\n';
+        return 1;
+    }
+
+    // Benchmark the scenes, returns the exit code of the program
+    int benchmark(vector<string> const &files, unsigned runs, double minPSNR,
+                  int threads, bool wavefront, string const &jsonFile,
+                  string const &csvFile)
+    try
+    {
+        Benchmark bench(runs, minPSNR);
+        if (threads >= 0)
+            bench.setNumThreads(threads);
+        bench.setUseWavefront(wavefront);
+
+        for (string const &file : files)
+        {
+            cout << "Benchmarking " << file << "...\n";
+            if (!bench.run(file))
+            {
+                cerr << "Error: reading scene from " << file << " failed.\n";
+                return 1;
+            }
+        }
+
+        cout << '\n';
+        bench.report(cout);
+
+        if (!jsonFile.empty())
+            bench.writeJSON(jsonFile);
+        if (!csvFile.empty())
+            bench.writeCSV(csvFile);
+
+        return bench.passed() ? 0 : 2;
+    }
+    catch (exception const &ex)
+    {
+        cerr << "Error: " << ex.what() << '\n';
+        return 1;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     cout << "Computer Graphics - Ray tracer\n\n";
 
-    if (argc < 2 || argc > 3)
+    // Separate the options from the file names
+    vector<string> files;
+    int threads = -1;       // -1: as specified by the scene
+    bool wavefront = false;
+    unsigned width = 0;     // 0: as specified by the scene
+    unsigned height = 0;
+    vector<unsigned> region;
+    string sampleCountFile;
+    string statisticsFile;
+    bool progressive = false;
+    double snapshotInterval = 10;
+    string stateFile;
+    bool sequence = false;
+    vector<unsigned> frames;    // first and last, empty: all
+    unsigned workers = 0;   // 0: render in this process
+    unsigned workerTileSize = 64;
+    double workerTimeout = 0;   // seconds, 0: wait forever
+
+    bool bench = false;
+    unsigned runs = 3;
+    double minPSNR = 40;
+    string jsonFile;
+    string csvFile;
+
+    try
+    {
+        for (int idx = 1; idx < argc; ++idx)
+        {
+            string arg = argv[idx];
+            if (arg == "--threads" && idx + 1 < argc)
+                threads = parseUnsigned(argv[++idx], numeric_limits<int>::max());
+            else if (arg == "--wavefront")
+                wavefront = true;
+            else if (arg == "--size" && idx + 1 < argc)
+            {
+                vector<unsigned> size = parseList(argv[++idx], 'x');
+                if (size.size() != 2 || size[0] == 0 || size[1] == 0)
+                    throw invalid_argument("--size expects WIDTHxHEIGHT");
+                width = size[0];
+                height = size[1];
+            }
+            else if (arg == "--region" && idx + 1 < argc)
+            {
+                region = parseList(argv[++idx], ',');
+                if (region.size() != 4)
+                    throw invalid_argument("--region expects X0,Y0,X1,Y1");
+            }
+            else if (arg == "--sample-counts" && idx + 1 < argc)
+                sampleCountFile = argv[++idx];
+            else if (arg == "--stats" && idx + 1 < argc)
+                statisticsFile = argv[++idx];
+            else if (arg == "--progressive")
+                progressive = true;
+            else if (arg == "--snapshot-interval" && idx + 1 < argc)
+            {
+                progressive = true;
+                snapshotInterval = stod(argv[++idx]);
+            }
+            else if (arg == "--state" && idx + 1 < argc)
+                stateFile = argv[++idx];
+            else if (arg == "--sequence")
+                sequence = true;
+            else if (arg == "--frames" && idx + 1 < argc)
+            {
+                sequence = true;
+                frames = parseList(argv[++idx], ',');
+                if (frames.size() != 2 || frames[0] > frames[1])
+                    throw invalid_argument("--frames expects FIRST,LAST");
+            }
+            else if (arg == "--workers" && idx + 1 < argc)
+                workers = parseUnsigned(argv[++idx]);
+            else if (arg == "--worker-tile-size" && idx + 1 < argc)
+                workerTileSize = parseUnsigned(argv[++idx]);
+            else if (arg == "--worker-timeout" && idx + 1 < argc)
+                workerTimeout = stod(argv[++idx]);
+            else if (arg == "--bench")
+                bench = true;
+            else if (arg == "--runs" && idx + 1 < argc)
+                runs = parseUnsigned(argv[++idx]);
+            else if (arg == "--json" && idx + 1 < argc)
+                jsonFile = argv[++idx];
+            else if (arg == "--csv" && idx + 1 < argc)
+                csvFile = argv[++idx];
+            else if (arg == "--min-psnr" && idx + 1 < argc)
+                minPSNR = stod(argv[++idx]);
+            else if (arg.compare(0, 2, "--") == 0)
+                throw invalid_argument("unknown option " + arg);
+            else
+                files.push_back(arg);
+        }
+    }
+    catch (exception const &ex)
+    {
+        cerr << "Error: invalid arguments (" << ex.what() << ").\n";
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (workers != 0 && sequence)
+    {
+        cerr << "Error: --workers cannot be combined with --sequence.\n";
+        return 1;
+    }
+
+    if (workers != 0 && (progressive || !stateFile.empty()
+                         || !sampleCountFile.empty() || !statisticsFile.empty()))
+    {
+        cerr << "Error: --workers cannot be combined with progressive "
+                "rendering, --sample-counts or --stats.\n";
+        return 1;
+    }
+
+    if (bench && !files.empty())
+        return benchmark(files, runs, minPSNR, threads, wavefront,
+                         jsonFile, csvFile);
+
+    if (files.size() < 1 || files.size() > 2)
     {
-        cerr << "Usage: " << argv[0] << " in-file [out-file.png]\n";
+        usage(argv[0]);
         return 1;
     }
 
     Raytracer raytracer;
 
     // read the scene
-    if (!raytracer.readScene(argv[1]))
+    if (!raytracer.readScene(files[0]))
     {
-        cerr << "Error: reading scene from " << argv[1] <<
+        cerr << "Error: reading scene from " << files[0] <<
             " failed - no output generated.\n";
         return 1;
     }
 
+    if (threads >= 0)
+        raytracer.setNumThreads(threads);
+
+    if (wavefront)
+        raytracer.setUseWavefront(true);
+
+    if (width != 0)
+        raytracer.setSize(width, height);
+
+    if (!region.empty()
+        && !raytracer.setRegion(region[0], region[1], region[2], region[3]))
+    {
+        cerr << "Error: the region is empty or not inside the image.\n";
+        return 1;
+    }
+
     // determine output name
     string ofname;
-    if (argc >= 3)
+    if (files.size() >= 2)
     {
-        ofname = argv[2];   // use the provided name
+        ofname = files[1];  // use the provided name
     }
     else
     {
-        ofname = argv[1];   // replace .json with .png
+        ofname = files[0];  // replace .json with .png
         ofname.erase(ofname.begin() + ofname.find_last_of('.'), ofname.end());
         ofname += ".png";
     }
 
+    if (workers != 0)
+        return distribute(argv[0], raytracer, files[0], ofname, workers,
+                          workerTileSize, workerTimeout, region, threads,
+                          wavefront);
+
+    if (!sampleCountFile.empty())
+        raytracer.setSampleCountFile(sampleCountFile);
+
+    if (!statisticsFile.empty())
+        raytracer.setStatisticsFile(statisticsFile);
+
+    if (progressive)
+        raytracer.setProgressive(snapshotInterval);
+
+    if (!stateFile.empty())
+        raytracer.setStateFile(stateFile);
+
+    if (sequence)
+    {
+        if (frames.empty())
+            frames = {0, raytracer.numFrames() - 1};
+        return renderSequence(raytracer, ofname, frames[0], frames[1]);
+    }
+
     raytracer.renderToFile(ofname);
 
     return 0;
@@ -0,0 +1,77 @@
+#include "mappedfile.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPEDFILE_MMAP
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile(string const &filename)
+:
+    d_data(nullptr),
+    d_size(0),
+    d_mapped(false)
+{
+#ifdef MAPPEDFILE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("Could not open " + filename + " for reading.");
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            // the file is read front to back
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            d_data = static_cast<char const *>(data);
+            d_size = info.st_size;
+            d_mapped = true;
+        }
+    }
+    close(fd);      // the mapping stays valid
+
+    if (d_mapped)
+        return;
+#endif
+
+    // Fall back to reading the file
+    ifstream file(filename, ios::binary);
+    if (!file)
+        throw runtime_error("Could not open " + filename + " for reading.");
+    d_contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    d_data = d_contents.data();
+    d_size = d_contents.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef MAPPEDFILE_MMAP
+    if (d_mapped)
+        munmap(const_cast<char *>(d_data), d_size);
+#endif
+}
+
+char const *MappedFile::begin() const
+{
+    return d_data;
+}
+
+char const *MappedFile::end() const
+{
+    return d_data + d_size;
+}
+
+size_t MappedFile::size() const
+{
+    return d_size;
+}
@@ -1,7 +1,7 @@
 #ifndef MATERIAL_H_
 #define MATERIAL_H_
 
-#include "image.h"
+#include "texture.h"
 #include "triple.h"
 
 class Material
@@ -14,7 +14,7 @@ class Material
         double n;           // exponent for specular highlight size
 
         bool hasTexture = false;
-        Image texture;
+        TexturePtr texture;     // shared with other materials using the file
 
         bool isTransparent = false;
         double nt = 1.0;
@@ -33,7 +33,7 @@ class Material
             texture()
         {}
 
-        Material(Image const &texture, double ka, double kd, double ks, double n)
+        Material(TexturePtr const &texture, double ka, double kd, double ks, double n)
         :
             color(),
             ka(ka),
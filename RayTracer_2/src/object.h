@@ -1,6 +1,7 @@
 #ifndef OBJECT_H_
 #define OBJECT_H_
 
+#include "aabb.h"
 #include "material.h"
 
 // not really needed here, but deriving classes may need them
@@ -8,6 +9,7 @@
 #include "ray.h"
 #include "triple.h"
 
+#include <limits>
 #include <memory>
 class Object;
 typedef std::shared_ptr<Object> ObjectPtr;
@@ -22,11 +24,37 @@ class Object
         virtual Hit intersect(Ray const &ray) = 0;  // must be implemented
                                                     // in derived class
 
+        // Whether the ray hits the object at a distance below maxT.
+        // Used for shadow rays, where any hit suffices: derived classes can
+        // override this to skip work only needed for the closest hit.
+        virtual bool intersectAny(Ray const &ray, Scalar maxT)
+        {
+            return intersect(ray).t < maxT;
+        }
+
         virtual Vector toUV(Point const &hit)
         {
             // bogus implementation
             return Vector{};
         }
+
+        // Texture coordinates at a point on (or, for texture filtering,
+        // near) the given part of the object, as reported by Hit::part.
+        // Objects made of parts with their own texture mapping override
+        // this, others ignore the part.
+        virtual Vector toUV(Point const &hit, unsigned part)
+        {
+            return toUV(hit);
+        }
+
+        // Bounding box of the object, used by the acceleration structure.
+        // Objects that do not override this are unbounded: they are
+        // intersected with every ray.
+        virtual AABB boundingBox() const
+        {
+            Scalar const inf = std::numeric_limits<Scalar>::infinity();
+            return AABB(Point(-inf, -inf, -inf), Point(inf, inf, inf));
+        }
 };
 
 #endif
@@ -3,12 +3,65 @@
 // Pro C++ Tip: here you can specify other includes you may need
 // such as <iostream>
 
-#include <fstream>
+#include "mappedfile.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
 #include <iostream>
-#include <sstream>
+#include <limits>
+#include <stdexcept>
 
 using namespace std;
 
+namespace
+{
+    size_t const NONE = numeric_limits<size_t>::max();
+    unsigned const NO_VERTEX = numeric_limits<unsigned>::max();
+
+    // Powers of ten which are exact in a double
+    double const POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    inline bool isSpace(char ch)
+    {
+        return ch == ' ' || ch == '\t' || ch == '\r';
+    }
+
+    inline bool isDigit(char ch)
+    {
+        return ch >= '0' && ch <= '9';
+    }
+
+    // skip spaces and tabs, not line ends
+    inline char const *skipSpace(char const *pos, char const *end)
+    {
+        while (pos != end && isSpace(*pos))
+            ++pos;
+        return pos;
+    }
+
+    // the start of the next line
+    inline char const *nextLine(char const *pos, char const *end)
+    {
+        pos = static_cast<char const *>(memchr(pos, '\n', end - pos));
+        return pos ? pos + 1 : end;
+    }
+
+    // whether the word at pos is keyword, followed by white space
+    inline bool isKeyword(char const *pos, char const *end, char const *keyword)
+    {
+        size_t length = strlen(keyword);
+        return static_cast<size_t>(end - pos) > length
+               && memcmp(pos, keyword, length) == 0
+               && isSpace(pos[length]);
+    }
+}
+
 // ===================================================================
 // -- Constructors and destructor ------------------------------------
 // ===================================================================
@@ -17,7 +70,9 @@ using namespace std;
 
 OBJLoader::OBJLoader(string const &filename)
 :
-    d_hasTexCoords(false)
+    d_hasTexCoords(false),
+    d_filename(filename),
+    d_line(0)
 {
     parseFile(filename);
 }
@@ -31,43 +86,25 @@ OBJLoader::OBJLoader(string const &filename)
 vector<Vertex> OBJLoader::vertex_data() const
 {
     vector<Vertex> data;
+    data.reserve(d_indices.size());
+    for (unsigned index : d_indices)
+        data.push_back(d_vertices[index]);
+    return data;
+}
 
-    // For all vertices in the model, interleave the data
-    for (Vertex_idx const &vertex : d_vertices)
-    {
-        // Add coordinate data
-        Vertex vert;
-
-        vec3 const coord = d_coordinates.at(vertex.d_coord);
-        vert.x = coord.x;
-        vert.y = coord.y;
-        vert.z = coord.z;
-
-        // Add normal data
-        vec3 const norm = d_normals.at(vertex.d_norm);
-        vert.nx = norm.x;
-        vert.ny = norm.y;
-        vert.nz = norm.z;
-
-        // Add texture data (if available)
-        if (d_hasTexCoords)
-        {
-            vec2 const tex = d_texCoords.at(vertex.d_tex);
-            vert.u = tex.u;      // u coordinate
-            vert.v = tex.v;      // v coordinate
-        } else {
-            vert.u = 0;
-            vert.v = 0;
-        }
-        data.push_back(vert);
-    }
+vector<Vertex> const &OBJLoader::vertices() const
+{
+    return d_vertices;
+}
 
-    return data;    // copy elision
+vector<unsigned> const &OBJLoader::indices() const
+{
+    return d_indices;
 }
 
 unsigned OBJLoader::numTriangles() const
 {
-    return d_vertices.size() / 3U;
+    return d_indices.size() / 3U;
 }
 
 bool OBJLoader::hasTexCoords() const
@@ -106,100 +143,287 @@ void OBJLoader::unitize()
 
 void OBJLoader::parseFile(string const &filename)
 {
-    ifstream file(filename);
-    if (file)
+    MappedFile file(filename);
+    char const *pos = file.begin();
+    char const *end = file.end();
+
+    // Every line is parsed where it is in the file, without copying it.
+    // Faces refer to the vertices defined before them, so the triangles
+    // are built as soon as their face is read.
+    while (pos != end)
     {
-        string line;
-        while(getline(file, line))
-            parseLine(line);
-
-    } else {
-        cerr << "Could not open: " << filename << " for reading!\n";
+        ++d_line;
+        pos = skipSpace(pos, end);
+
+        if (isKeyword(pos, end, "v"))
+            pos = parseVertex(pos + 1, end);
+        else if (isKeyword(pos, end, "vn"))
+            pos = parseNormal(pos + 2, end);
+        else if (isKeyword(pos, end, "vt"))
+            pos = parseTexCoord(pos + 2, end);
+        else if (isKeyword(pos, end, "f"))
+            pos = parseFace(pos + 1, end);
+
+        // Comments and other data are ignored, as is anything after the
+        // data that was parsed (such as vertex colors).
+        pos = nextLine(pos, end);
     }
+
+    smoothNormals();
 }
 
-void OBJLoader::parseLine(string const &line)
+char const *OBJLoader::parseVertex(char const *pos, char const *end)
 {
-    if (line[0] == '#')
-        return;                     // ignore comments
+    vec3 coord;
+    pos = parseFloat(pos, end, coord.x);
+    pos = parseFloat(pos, end, coord.y);
+    pos = parseFloat(pos, end, coord.z);
+    d_coordinates.push_back(coord);
+    d_coordVertex.push_back(NO_VERTEX);
+    return pos;
+}
 
-    StringList tokens = split(line, ' ', false);
+char const *OBJLoader::parseNormal(char const *pos, char const *end)
+{
+    vec3 norm;
+    pos = parseFloat(pos, end, norm.x);
+    pos = parseFloat(pos, end, norm.y);
+    pos = parseFloat(pos, end, norm.z);
+    d_normals.push_back(norm);
+    return pos;
+}
 
-    if (tokens[0] == "v")
-        parseVertex(tokens);
-    else if (tokens[0] == "vn")
-        parseNormal(tokens);
-    else if (tokens[0] == "vt")
-        parseTexCoord(tokens);
-    else if (tokens[0] == "f")
-        parseFace(tokens);
+char const *OBJLoader::parseTexCoord(char const *pos, char const *end)
+{
+    d_hasTexCoords = true;          // Texture data will be read
 
-    // Other data is also ignored
+    vec2 tex;
+    pos = parseFloat(pos, end, tex.u);
+    pos = parseFloat(pos, end, tex.v);
+    d_texCoords.push_back(tex);
+    return pos;
 }
 
-void OBJLoader::parseVertex(StringList const &tokens)
+char const *OBJLoader::parseFace(char const *pos, char const *end)
 {
-    float x, y, z;
-    x = stof(tokens.at(1));         // 0 is the "v" token
-    y = stof(tokens.at(2));
-    z = stof(tokens.at(3));
-    d_coordinates.push_back(vec3{x, y, z});
+    // Vertices are given as v, v/vt, v//vn or v/vt/vn. Indices start
+    // at 1; negative indices count back from the last element defined.
+    d_face.clear();
+    while (true)
+    {
+        pos = skipSpace(pos, end);
+        if (pos == end || *pos == '\n' || *pos == '#')
+            break;
+
+        Vertex_idx vertex {NONE, NONE, NONE};
+        pos = parseIndex(pos, end, d_coordinates.size(), vertex.d_coord);
+        if (pos != end && *pos == '/')
+        {
+            ++pos;
+            if (pos != end && *pos != '/')
+                pos = parseIndex(pos, end, d_texCoords.size(), vertex.d_tex);
+            if (pos != end && *pos == '/')
+                pos = parseIndex(pos + 1, end, d_normals.size(), vertex.d_norm);
+        }
+        d_face.push_back(vertex);
+    }
+
+    if (d_face.size() < 3)
+        error("a face needs at least three vertices");
+
+    // Polygons are split into a fan of triangles around the first vertex
+    for (size_t idx = 2; idx != d_face.size(); ++idx)
+        addTriangle(d_face[0], d_face[idx - 1], d_face[idx]);
+    return pos;
 }
 
-void OBJLoader::parseNormal(StringList const &tokens)
+char const *OBJLoader::parseFloat(char const *pos, char const *end, float &value)
 {
-    float x, y, z;
-    x = stof(tokens.at(1));         // 0 is the "vn" token
-    y = stof(tokens.at(2));
-    z = stof(tokens.at(3));
-    d_normals.push_back(vec3{x, y, z});
+    pos = skipSpace(pos, end);
+    char const *start = pos;
+
+    bool negative = false;
+    if (pos != end && (*pos == '-' || *pos == '+'))
+        negative = *pos++ == '-';
+
+    // Collect up to 19 significant digits, which fit in 64 bits
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool exact = true;
+    bool any = false;
+
+    for (; pos != end && isDigit(*pos); ++pos, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*pos - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            ++exponent;
+            exact = false;
+        }
+    }
+
+    if (pos != end && *pos == '.')
+    {
+        for (++pos; pos != end && isDigit(*pos); ++pos, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*pos - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+            else
+                exact = false;
+        }
+    }
+
+    if (!any)
+        error("expected a number");
+
+    if (pos != end && (*pos == 'e' || *pos == 'E'))
+    {
+        char const *exp = pos + 1;
+        bool negativeExp = false;
+        if (exp != end && (*exp == '-' || *exp == '+'))
+            negativeExp = *exp++ == '-';
+
+        if (exp != end && isDigit(*exp))
+        {
+            int power = 0;
+            for (; exp != end && isDigit(*exp); ++exp)
+                power = min(power * 10 + (*exp - '0'), 10000);
+            exponent += negativeExp ? -power : power;
+            pos = exp;
+        }
+    }
+
+    // A mantissa of at most 53 bits and a power of ten up to 1e22 are
+    // both exact doubles, so one multiplication or division gives the
+    // correctly rounded double. Other numbers are left to strtof.
+    if (exact && mantissa < (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+    {
+        double result = static_cast<double>(mantissa);
+        result = exponent < 0 ? result / POW10[-exponent] : result * POW10[exponent];
+        value = static_cast<float>(negative ? -result : result);
+        return pos;
+    }
+
+    char buffer[128];
+    size_t length = min(static_cast<size_t>(pos - start), sizeof buffer - 1);
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    value = strtof(buffer, nullptr);
+    return pos;
 }
 
-void OBJLoader::parseTexCoord(StringList const &tokens)
+char const *OBJLoader::parseIndex(char const *pos, char const *end,
+                                  size_t count, size_t &index)
 {
-    d_hasTexCoords = true;          // Texture data will be read
-
-    float u, v;
-    u = stof(tokens.at(1));         // 0 is the "vt" token
-    v = stof(tokens.at(2));
-    d_texCoords.push_back(vec2{u, v});
+    bool negative = pos != end && *pos == '-';
+    if (negative)
+        ++pos;
+
+    if (pos == end || !isDigit(*pos))
+        error("expected an index");
+
+    // stop accumulating once out of range, so it cannot overflow
+    size_t number = 0;
+    for (; pos != end && isDigit(*pos); ++pos)
+        if (number <= count)
+            number = number * 10 + (*pos - '0');
+
+    // 1 is the first element, -1 the last one defined so far
+    if (number == 0 || number > count)
+        error("index out of range");
+    index = negative ? count - number : number - 1;
+    return pos;
 }
 
-void OBJLoader::parseFace(StringList const &tokens)
+void OBJLoader::addTriangle(Vertex_idx const &a, Vertex_idx const &b,
+                            Vertex_idx const &c)
 {
-    // skip the first token ("f")
-    for (size_t idx = 1; idx < tokens.size(); ++idx)
+    unsigned const corners[] = {vertexIndex(a), vertexIndex(b), vertexIndex(c)};
+    d_indices.insert(d_indices.end(), begin(corners), end(corners));
+
+    if (a.d_norm != NONE && b.d_norm != NONE && c.d_norm != NONE)
+        return;
+
+    // Vertices without a normal accumulate the normals of their
+    // triangles, weighted by area (the length of the cross product)
+    vec3 const &p0 = d_coordinates[a.d_coord];
+    vec3 const &p1 = d_coordinates[b.d_coord];
+    vec3 const &p2 = d_coordinates[c.d_coord];
+    float e1x = p1.x - p0.x, e1y = p1.y - p0.y, e1z = p1.z - p0.z;
+    float e2x = p2.x - p0.x, e2y = p2.y - p0.y, e2z = p2.z - p0.z;
+    float nx = e1y * e2z - e1z * e2y;
+    float ny = e1z * e2x - e1x * e2z;
+    float nz = e1x * e2y - e1y * e2x;
+
+    for (unsigned corner : corners)
     {
-        // format is:
-        // <vertex idx + 1>/<texture idx +1>/<normal idx + 1>
-        // Wavefront .obj files start counting from 1 (yuck)
+        if (d_vertexIdx[corner].d_norm != NONE)
+            continue;
 
-        StringList elements = split(tokens.at(idx), '/');
-        Vertex_idx vertex {}; // initialize to zeros on all fields
+        Vertex &vertex = d_vertices[corner];
+        vertex.nx += nx;
+        vertex.ny += ny;
+        vertex.nz += nz;
+    }
+}
 
-        vertex.d_coord = stoul(elements.at(0)) - 1U;
+unsigned OBJLoader::vertexIndex(Vertex_idx const &vertex)
+{
+    // Vertices sharing a coordinate (usually one, a few on seams) are
+    // chained, so no hashing is needed to find an existing one.
+    unsigned *link = &d_coordVertex[vertex.d_coord];
+    for (; *link != NO_VERTEX; link = &d_nextVertex[*link])
+    {
+        Vertex_idx const &other = d_vertexIdx[*link];
+        if (other.d_norm == vertex.d_norm && other.d_tex == vertex.d_tex)
+            return *link;
+    }
 
-        if (d_hasTexCoords)
-            vertex.d_tex = stoul(elements.at(1)) - 1U;
-        else
-            vertex.d_tex = 0U;       // ignored
+    unsigned index = d_vertices.size();
+    *link = index;
+    d_nextVertex.push_back(NO_VERTEX);
+    d_vertexIdx.push_back(vertex);
+
+    vec3 const &coord = d_coordinates[vertex.d_coord];
+    vec3 const norm = vertex.d_norm == NONE ? vec3{0, 0, 0}
+                                            : d_normals[vertex.d_norm];
+    vec2 const tex = vertex.d_tex == NONE ? vec2{0, 0}
+                                          : d_texCoords[vertex.d_tex];
+    d_vertices.push_back(Vertex{coord.x, coord.y, coord.z,
+                                norm.x, norm.y, norm.z,
+                                tex.u, tex.v});
+    return index;
+}
 
-        vertex.d_norm = stoul(elements.at(2)) - 1U;
+void OBJLoader::smoothNormals()
+{
+    for (size_t idx = 0; idx != d_vertices.size(); ++idx)
+    {
+        if (d_vertexIdx[idx].d_norm != NONE)
+            continue;
 
-        d_vertices.push_back(vertex);
+        Vertex &vertex = d_vertices[idx];
+        float length = sqrt(vertex.nx * vertex.nx + vertex.ny * vertex.ny
+                            + vertex.nz * vertex.nz);
+        if (length > 0)
+        {
+            vertex.nx /= length;
+            vertex.ny /= length;
+            vertex.nz /= length;
+        }
     }
 }
 
-OBJLoader::StringList OBJLoader::split(string const &line,
-                            char splitChar,
-                            bool keepEmpty)
+void OBJLoader::error(string const &message) const
 {
-    StringList tokens;
-    istringstream iss(line);
-    string token;
-    while (getline(iss, token, splitChar))
-        if (token.size() > 0 || (token.size() == 0 && keepEmpty))
-            tokens.push_back(token);
-
-    return tokens;
+    throw runtime_error(d_filename + ":" + to_string(d_line) + ": " + message);
 }
@@ -34,8 +34,9 @@ class OBJLoader
     /**
      * @brief The Vertex struct
      * Contains indices into the above
-     * QVectors to be able to reconstruct
-     * the model
+     * vectors to be able to reconstruct
+     * the model, NONE for missing
+     * texture coordinates and normals
      */
     struct Vertex_idx
     {
@@ -44,27 +45,60 @@ class OBJLoader
         size_t d_tex;
     };
 
-    std::vector<Vertex_idx> d_vertices;
+    // the vertices of the face being parsed (reused for every face)
+    std::vector<Vertex_idx> d_face;
 
-    typedef std::vector<std::string> StringList;
+    // Unique vertices (combinations of coordinate, normal and texture
+    // coordinate) and three indices into them per triangle
+    std::vector<Vertex> d_vertices;
+    std::vector<unsigned> d_indices;
+
+    // For finding the vertex of a face vertex: per coordinate the first
+    // vertex using it, per vertex the next one using the same coordinate
+    // and the indices it was made of.
+    std::vector<unsigned> d_coordVertex;
+    std::vector<unsigned> d_nextVertex;
+    std::vector<Vertex_idx> d_vertexIdx;
+
+    // for error messages
+    std::string d_filename;
+    size_t d_line;
 
     public:
 
         /**
          * @brief OBJLoader
          * @param filename
+         *
+         * Throws runtime_error if the file cannot be read or is
+         * malformed.
          */
         explicit OBJLoader(std::string const &filename);
 
         /**
          * @brief vertex_data
-         * @return interleaved vertex data, see vertex.h
+         * @return interleaved vertex data, three vertices per
+         *  triangle, see vertex.h
          *
          * @note texCoord is only valid when hasTexCoords() returns
          *  true
          */
         std::vector<Vertex> vertex_data() const;
 
+        /**
+         * @brief vertices
+         * @return the unique vertices of the model. Vertices for
+         *  which the file gives no normal get the average normal of
+         *  the triangles they are part of (weighted by area).
+         */
+        std::vector<Vertex> const &vertices() const;
+
+        /**
+         * @brief indices
+         * @return three indices into vertices() per triangle
+         */
+        std::vector<unsigned> const &indices() const;
+
         unsigned numTriangles() const;
 
         bool hasTexCoords() const;
@@ -78,17 +112,29 @@ class OBJLoader
 
     private:
 
+        // The parse functions get the position after the keyword of
+        // the line and return the position where they stopped.
         void parseFile(std::string const &filename);
-        void parseLine(std::string const &line);
-        void parseVertex(StringList const &tokens);
-        void parseNormal(StringList const &tokens);
-        void parseTexCoord(StringList const &tokens);
-        void parseFace(StringList const &tokens);
+        char const *parseVertex(char const *pos, char const *end);
+        char const *parseNormal(char const *pos, char const *end);
+        char const *parseTexCoord(char const *pos, char const *end);
+        char const *parseFace(char const *pos, char const *end);
+
+        char const *parseFloat(char const *pos, char const *end, float &value);
+        char const *parseIndex(char const *pos, char const *end,
+                               size_t count, size_t &index);
+
+        // add the triangle of face vertices a, b and c
+        void addTriangle(Vertex_idx const &a, Vertex_idx const &b,
+                         Vertex_idx const &c);
+
+        // index in d_vertices of the face vertex, added if new
+        unsigned vertexIndex(Vertex_idx const &vertex);
 
-        StringList split(std::string const &str,
-                             char splitChar,
-                             bool keepEmpty = true);
+        // normalize the normals of vertices without one in the file
+        void smoothNormals();
 
+        [[noreturn]] void error(std::string const &message) const;
 };
 
 #endif // OBJLOADER_H_
@@ -0,0 +1,238 @@
+#include "primitivestore.h"
+
+#include "statistics.h"
+#include "shapes/quad.h"
+#include "shapes/solvers.h"
+#include "shapes/sphere.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+    Scalar const NO_HIT = numeric_limits<Scalar>::quiet_NaN();
+
+    // Offsets are at least this many units in the last place of the largest
+    // coordinate of the hit point or the primitive.
+    Scalar const RELATIVE_OFFSET = 64 * numeric_limits<Scalar>::epsilon();
+
+    Scalar maxAbs(Point const &p)
+    {
+        return max(abs(p.x), max(abs(p.y), abs(p.z)));
+    }
+}
+
+void PrimitiveStore::build(vector<ObjectPtr> const &objects)
+{
+    clear();
+    d_kind.reserve(objects.size());
+    d_slot.reserve(objects.size());
+    d_scale.reserve(objects.size());
+
+    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    {
+        Object *obj = objects[idx].get();
+
+        AABB box = obj->boundingBox();
+        d_scale.push_back(box.isFinite() ? max(maxAbs(box.min), maxAbs(box.max)) : 0);
+
+        if (Sphere const *sphere = dynamic_cast<Sphere const *>(obj))
+            addSphere(idx, *sphere);
+        else if (Quad const *quad = dynamic_cast<Quad const *>(obj))
+            addQuad(idx, *quad);
+        else
+        {
+            d_kind.push_back(OTHER);
+            d_slot.push_back(d_other.size());
+            d_other.push_back(obj);
+            d_otherObject.push_back(idx);
+        }
+    }
+}
+
+void PrimitiveStore::clear()
+{
+    *this = PrimitiveStore();
+}
+
+Scalar PrimitiveStore::intersect(unsigned prim, Ray const &ray, Hit &other) const
+{
+    switch (d_kind[prim])
+    {
+        case SPHERE:
+            return intersectSphere(d_slot[prim], ray);
+        case QUAD:
+            return intersectQuad(d_slot[prim], ray);
+        default:
+            other = d_other[d_slot[prim]]->intersect(ray);
+            return other.t;
+    }
+}
+
+bool PrimitiveStore::intersectAny(unsigned prim, Ray const &ray, Scalar maxT) const
+{
+    switch (d_kind[prim])
+    {
+        case SPHERE:
+            return intersectSphere(d_slot[prim], ray) < maxT;
+        case QUAD:
+            return intersectQuad(d_slot[prim], ray) < maxT;
+        default:
+            return d_other[d_slot[prim]]->intersectAny(ray, maxT);
+    }
+}
+
+Vector PrimitiveStore::normal(unsigned prim, Ray const &ray, Scalar t,
+                              Hit const &other, unsigned &part) const
+{
+    part = 0;
+    unsigned slot = d_slot[prim];
+    switch (d_kind[prim])
+    {
+        case SPHERE:
+        {
+            Point center(d_sphereX[slot], d_sphereY[slot], d_sphereZ[slot]);
+            return (ray.at(t) - center).normalized();
+        }
+        case QUAD:
+            return d_quadN[slot];
+        default:
+            part = other.part;
+            return other.N;
+    }
+}
+
+Scalar PrimitiveStore::offset(unsigned prim, Point const &hit, Scalar minOffset) const
+{
+    Scalar scale = max(d_scale[prim], maxAbs(hit));
+    return max(minOffset, RELATIVE_OFFSET * scale);
+}
+
+void PrimitiveStore::closestHit(Ray const &ray, Scalar &tMax, unsigned &prim,
+                                Hit &other) const
+{
+    auto update = [&](Scalar t, unsigned object)
+    {
+        if (t < tMax || (t == tMax && object < prim))
+        {
+            tMax = t;
+            prim = object;
+        }
+    };
+
+    for (unsigned slot = 0; slot != d_sphereObject.size(); ++slot)
+        update(intersectSphere(slot, ray), d_sphereObject[slot]);
+
+    for (unsigned slot = 0; slot != d_quadObject.size(); ++slot)
+        update(intersectQuad(slot, ray), d_quadObject[slot]);
+
+    for (unsigned slot = 0; slot != d_other.size(); ++slot)
+    {
+        Hit hit = d_other[slot]->intersect(ray);
+        if (hit.t < tMax || (hit.t == tMax && d_otherObject[slot] < prim))
+            other = hit;
+        update(hit.t, d_otherObject[slot]);
+    }
+}
+
+bool PrimitiveStore::anyHit(Ray const &ray, Scalar maxT, unsigned &tests) const
+{
+    tests = 0;
+
+    for (unsigned slot = 0; slot != d_sphereObject.size(); ++slot)
+    {
+        STAT_COUNT(tests);
+        if (intersectSphere(slot, ray) < maxT)
+            return true;
+    }
+
+    for (unsigned slot = 0; slot != d_quadObject.size(); ++slot)
+    {
+        STAT_COUNT(tests);
+        if (intersectQuad(slot, ray) < maxT)
+            return true;
+    }
+
+    for (Object *obj : d_other)
+    {
+        STAT_COUNT(tests);
+        if (obj->intersectAny(ray, maxT))
+            return true;
+    }
+
+    return false;
+}
+
+// --- Private -----------------------------------------------------------------
+
+void PrimitiveStore::addSphere(unsigned object, Sphere const &sphere)
+{
+    d_kind.push_back(SPHERE);
+    d_slot.push_back(d_sphereObject.size());
+    d_sphereX.push_back(sphere.position.x);
+    d_sphereY.push_back(sphere.position.y);
+    d_sphereZ.push_back(sphere.position.z);
+    d_sphereR.push_back(sphere.r);
+    d_sphereObject.push_back(object);
+}
+
+void PrimitiveStore::addQuad(unsigned object, Quad const &quad)
+{
+    d_kind.push_back(QUAD);
+    d_slot.push_back(d_quadObject.size());
+    d_quadV0.push_back(quad.v0);
+    d_quadEdge1.push_back(quad.v1 - quad.v0);
+    d_quadEdge3.push_back(quad.v3 - quad.v0);
+    d_quadLength1.push_back((quad.v1 - quad.v0).length_2());
+    d_quadLength3.push_back((quad.v3 - quad.v0).length_2());
+    d_quadN.push_back(quad.N);
+    d_quadObject.push_back(object);
+}
+
+// The tests below compute exactly what Sphere::intersect and
+// Quad::intersect compute, so both give the same images.
+
+Scalar PrimitiveStore::intersectSphere(unsigned slot, Ray const &ray) const
+{
+    Point center(d_sphereX[slot], d_sphereY[slot], d_sphereZ[slot]);
+    Scalar r = d_sphereR[slot];
+
+    Vector L = ray.O - center;
+    Scalar a = ray.D.dot(ray.D);
+    Scalar b = 2.0 * ray.D.dot(L);
+    Scalar c = L.dot(L) - r * r;
+
+    Scalar t0;
+    Scalar t1;
+    if (not Solvers::quadratic(a, b, c, t0, t1))
+        return NO_HIT;
+
+    Scalar t = t0 < 0.0 ? t1 : t0;
+    return t < 0.0 ? NO_HIT : t;
+}
+
+Scalar PrimitiveStore::intersectQuad(unsigned slot, Ray const &ray) const
+{
+    Vector const &N = d_quadN[slot];
+    Point const &v0 = d_quadV0[slot];
+
+    Scalar DdotN = (-ray.D).dot(N);
+    if (abs(DdotN) < numeric_limits<Scalar>::epsilon())
+        return NO_HIT;
+
+    Scalar t = -N.dot(ray.O - v0) / N.dot(ray.D);
+    if (t < 0.0)
+        return NO_HIT;
+
+    Vector P = ray.at(t) - v0;
+    Scalar u = P.dot(d_quadEdge1[slot]);
+    Scalar v = P.dot(d_quadEdge3[slot]);
+    if (0.0 <= u and u <= d_quadLength1[slot] and
+        0.0 <= v and v <= d_quadLength3[slot])
+        return t;
+
+    return NO_HIT;
+}
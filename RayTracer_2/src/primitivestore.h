@@ -0,0 +1,103 @@
+#ifndef PRIMITIVESTORE_H_
+#define PRIMITIVESTORE_H_
+
+#include "hit.h"
+#include "object.h"
+
+#include <vector>
+
+class Quad;
+class Sphere;
+
+// Packed copy of the geometry of the scene objects, used for intersection
+// tests instead of the virtual Object::intersect. Spheres and quads are
+// stored per type in contiguous arrays, so testing them needs no pointer
+// chasing, virtual calls or reference counting. Other types of objects are
+// still intersected through their Object interface.
+//
+// Primitives are identified by the index of their object in the scene, which
+// is also how the material of a hit primitive is found.
+class PrimitiveStore
+{
+    enum Kind : unsigned char
+    {
+        SPHERE,
+        QUAD,
+        OTHER
+    };
+
+    // per object: its kind and its index in the arrays of that kind
+    std::vector<Kind> d_kind;
+    std::vector<unsigned> d_slot;
+
+    // per object: largest absolute coordinate of its bounding box (0 for
+    // unbounded objects), the scale of the rounding errors in its hits
+    std::vector<Scalar> d_scale;
+
+    // spheres: center and radius
+    std::vector<Scalar> d_sphereX;
+    std::vector<Scalar> d_sphereY;
+    std::vector<Scalar> d_sphereZ;
+    std::vector<Scalar> d_sphereR;
+    std::vector<unsigned> d_sphereObject;
+
+    // quads: corner v0, edges v1 - v0 and v3 - v0 with their squared
+    // lengths, and the normal
+    std::vector<Point> d_quadV0;
+    std::vector<Vector> d_quadEdge1;
+    std::vector<Vector> d_quadEdge3;
+    std::vector<Scalar> d_quadLength1;
+    std::vector<Scalar> d_quadLength3;
+    std::vector<Vector> d_quadN;
+    std::vector<unsigned> d_quadObject;
+
+    // everything else
+    std::vector<Object *> d_other;
+    std::vector<unsigned> d_otherObject;
+
+    public:
+        // build the store from the objects of the scene
+        void build(std::vector<ObjectPtr> const &objects);
+        void clear();
+
+        // Distance to the closest hit of the ray with primitive prim,
+        // NaN if it is missed. If prim is neither a sphere nor a quad,
+        // other receives its Hit, to pass to normal.
+        Scalar intersect(unsigned prim, Ray const &ray, Hit &other) const;
+
+        // Whether the ray hits primitive prim before maxT.
+        bool intersectAny(unsigned prim, Ray const &ray, Scalar maxT) const;
+
+        // Normal of primitive prim where the ray hits it at distance t.
+        // part receives the part hit (see Hit::part). For other objects
+        // than spheres and quads, both are taken from other, the Hit
+        // intersect returned for the ray.
+        Vector normal(unsigned prim, Ray const &ray, Scalar t, Hit const &other,
+                      unsigned &part) const;
+
+        // Distance to move a point hit on primitive prim off its surface
+        // before casting new rays from it. This is at least minOffset, and
+        // grows with the magnitude of the coordinates involved, so it
+        // exceeds the rounding errors of the hit (in particular in single
+        // precision, where a fixed offset leads to acne on large scenes).
+        Scalar offset(unsigned prim, Point const &hit, Scalar minOffset) const;
+
+        // Test all primitives, type by type. On a hit closer than tMax,
+        // tMax and prim are updated (and other, see intersect); equally
+        // close hits resolve to the lowest index.
+        void closestHit(Ray const &ray, Scalar &tMax, unsigned &prim,
+                        Hit &other) const;
+
+        // Whether the ray hits any primitive before maxT. tests receives the
+        // number of primitives tested (only counted with RAY_STATISTICS).
+        bool anyHit(Ray const &ray, Scalar maxT, unsigned &tests) const;
+
+    private:
+        void addSphere(unsigned object, Sphere const &sphere);
+        void addQuad(unsigned object, Quad const &quad);
+
+        Scalar intersectSphere(unsigned slot, Ray const &ray) const;
+        Scalar intersectQuad(unsigned slot, Ray const &ray) const;
+};
+
+#endif
@@ -0,0 +1,291 @@
+#include "progressive.h"
+
+#include "image.h"
+#include "scene.h"
+#include "tilescheduler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    // pixel strides of the passes of the first sample
+    unsigned const STRIDES[] = {8, 4, 2, 1};
+    unsigned const NUM_COARSE = sizeof STRIDES / sizeof STRIDES[0];
+
+    char const MAGIC[8] = {'R', 'T', '2', 'P', 'R', 'O', 'G', '\0'};
+    uint32_t const VERSION = 1;
+
+    // Header of a state file. It is followed by the sample count (uint32)
+    // and the sum of the samples (three doubles) of every pixel.
+    struct StateHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t samples;
+        uint64_t sceneHash;
+    };
+
+    uint64_t fnv1a(string const &text)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char ch : text)
+        {
+            hash ^= ch;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+}
+
+Progressive::Progressive(Scene &scene, unsigned width, unsigned height,
+                         string const &sceneText)
+:
+    d_scene(scene),
+    d_width(width),
+    d_height(height),
+    d_samples(scene.samplesPerPixel()),
+    d_sceneHash(fnv1a(sceneText)),
+    d_sums(width * height),
+    d_counts(width * height, 0),
+    d_interval(10)
+{}
+
+void Progressive::setSnapshotFile(string const &filename)
+{
+    d_snapshotFile = filename;
+}
+
+void Progressive::setStateFile(string const &filename)
+{
+    d_stateFile = filename;
+}
+
+void Progressive::setInterval(double seconds)
+{
+    d_interval = seconds;
+}
+
+bool Progressive::resume()
+{
+    ifstream in(d_stateFile, ios::binary);
+    if (!in)
+        return false;
+
+    StateHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof header)
+        || !equal(begin(MAGIC), end(MAGIC), header.magic)
+        || header.version != VERSION
+        || header.width != d_width
+        || header.height != d_height
+        || header.samples != d_samples
+        || header.sceneHash != d_sceneHash)
+        return false;
+
+    vector<uint32_t> counts(d_counts.size());
+    vector<double> sums(3 * d_sums.size());
+    in.read(reinterpret_cast<char *>(counts.data()), counts.size() * sizeof(uint32_t));
+    in.read(reinterpret_cast<char *>(sums.data()), sums.size() * sizeof(double));
+    if (!in)
+        throw runtime_error("Could not read the state in " + d_stateFile + '.');
+
+    for (unsigned idx = 0; idx != d_counts.size(); ++idx)
+    {
+        d_counts[idx] = min(counts[idx], d_samples);
+        d_sums[idx] = Color(sums[3 * idx], sums[3 * idx + 1], sums[3 * idx + 2]);
+    }
+    return true;
+}
+
+unsigned Progressive::numPasses() const
+{
+    return NUM_COARSE + d_samples - 1;
+}
+
+unsigned long Progressive::samplesDone() const
+{
+    unsigned long done = 0;
+    for (unsigned count : d_counts)
+        done += count;
+    return done;
+}
+
+unsigned long Progressive::totalSamples() const
+{
+    return static_cast<unsigned long>(d_samples) * d_counts.size();
+}
+
+void Progressive::render(Image &img)
+{
+    d_scene.stats = Statistics();
+    d_lastSnapshot = chrono::steady_clock::now();
+
+    for (unsigned pass = 0; pass != numPasses(); ++pass)
+    {
+        renderPass(pass);
+        cout << "Pass " << pass + 1 << " of " << numPasses() << " done ("
+             << 100.0 * samplesDone() / totalSamples() << "% of the samples).\n";
+
+        // The first pass is quick, show its result right away
+        if (pass == 0)
+        {
+            lock_guard<mutex> guard(d_lock);
+            snapshot();
+        }
+    }
+
+    toImage(img);
+    if (!d_stateFile.empty() && !saveState())
+        cerr << "Warning: could not write the state to " << d_stateFile << ".\n";
+}
+
+vector<unsigned> const &Progressive::sampleCounts() const
+{
+    return d_counts;
+}
+
+// --- Private -----------------------------------------------------------------
+
+bool Progressive::needs(unsigned pass, unsigned x, unsigned y, unsigned idx) const
+{
+    if (pass >= NUM_COARSE)
+        return d_counts[idx] == pass - NUM_COARSE + 1;
+
+    unsigned stride = STRIDES[pass];
+    return d_counts[idx] == 0 && x % stride == 0 && y % stride == 0;
+}
+
+void Progressive::renderPass(unsigned pass)
+{
+    unsigned index = pass < NUM_COARSE ? 0 : pass - NUM_COARSE + 1;
+
+    TileScheduler scheduler(d_width, d_height, d_scene.tileSize,
+                            d_scene.numThreads);
+    scheduler.run([&](TileScheduler::Tile const &tile)
+    {
+        Statistics &local = Statistics::local();
+        local = Statistics();
+
+        // Only this tile changes the counts of its pixels, so they can be
+        // read without the lock.
+        vector<unsigned> pixels;
+        vector<Color> colors;
+        for (unsigned y = tile.y0; y < tile.y1; ++y)
+            for (unsigned x = tile.x0; x < tile.x1; ++x)
+            {
+                unsigned idx = y * d_width + x;
+                if (needs(pass, x, y, idx))
+                {
+                    pixels.push_back(idx);
+                    colors.push_back(sample(x, y, index));
+                }
+            }
+
+        lock_guard<mutex> guard(d_lock);
+        for (unsigned pos = 0; pos != pixels.size(); ++pos)
+        {
+            d_sums[pixels[pos]] += colors[pos];
+            ++d_counts[pixels[pos]];
+        }
+        d_scene.stats += local;
+
+        auto now = chrono::steady_clock::now();
+        if (chrono::duration<double>(now - d_lastSnapshot).count() >= d_interval)
+            snapshot();
+    });
+}
+
+Color Progressive::sample(unsigned x, unsigned y, unsigned index) const
+{
+    // Scene::supersample visits the four quadrants of a pixel in the order
+    // top left, top right, bottom right, bottom left, recursively. The
+    // digits of the index (in base 4, most significant first) select them.
+    Scalar px = d_scene.screenX(x);
+    Scalar py = d_scene.screenY(y);
+    Scalar shift = 0.25;
+    for (unsigned level = d_scene.supersamplingFactor - 1; level-- != 0; )
+    {
+        unsigned quadrant = index >> 2 * level & 3;
+        px = quadrant == 0 || quadrant == 3 ? px - shift : px + shift;
+        py = quadrant < 2 ? py + shift : py - shift;
+        shift = shift / 2.0;
+    }
+    return d_scene.sample(px, py, false, 4 * shift);
+}
+
+void Progressive::toImage(Image &img) const
+{
+    for (unsigned y = 0; y != d_height; ++y)
+        for (unsigned x = 0; x != d_width; ++x)
+        {
+            // Pixels without samples yet take the color of the pixel at
+            // the corner of the smallest block rendered around them.
+            unsigned idx = y * d_width + x;
+            for (unsigned stride = 2; d_counts[idx] == 0 && stride <= STRIDES[0]; stride *= 2)
+                idx = (y - y % stride) * d_width + x - x % stride;
+
+            Color col;
+            if (d_counts[idx] != 0)
+            {
+                col = d_sums[idx];
+                col /= d_counts[idx];
+                col.clamp();
+            }
+            img(x, y) = col;
+        }
+}
+
+void Progressive::snapshot()
+{
+    d_lastSnapshot = chrono::steady_clock::now();
+
+    if (!d_snapshotFile.empty())
+    {
+        // Written to a temporary file first, so a crash cannot leave a
+        // truncated image behind
+        Image img(d_width, d_height);
+        toImage(img);
+        string tmpFile = d_snapshotFile + ".tmp";
+        img.write_png(tmpFile);
+        rename(tmpFile.c_str(), d_snapshotFile.c_str());
+    }
+
+    if (!d_stateFile.empty() && !saveState())
+        cerr << "Warning: could not write the state to " << d_stateFile << ".\n";
+
+    cout << "Snapshot at " << 100.0 * samplesDone() / totalSamples()
+         << "% of the samples.\n";
+}
+
+bool Progressive::saveState() const
+{
+    StateHeader header;
+    copy(begin(MAGIC), end(MAGIC), header.magic);
+    header.version = VERSION;
+    header.width = d_width;
+    header.height = d_height;
+    header.samples = d_samples;
+    header.sceneHash = d_sceneHash;
+
+    vector<uint32_t> counts(d_counts.begin(), d_counts.end());
+    vector<double> sums;
+    sums.reserve(3 * d_sums.size());
+    for (Color const &sum : d_sums)
+        sums.insert(sums.end(), {sum.r, sum.g, sum.b});
+
+    string tmpFile = d_stateFile + ".tmp";
+    ofstream out(tmpFile, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<char const *>(&header), sizeof header);
+    out.write(reinterpret_cast<char const *>(counts.data()), counts.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<char const *>(sums.data()), sums.size() * sizeof(double));
+    out.close();
+
+    return out && rename(tmpFile.c_str(), d_stateFile.c_str()) == 0;
+}
@@ -0,0 +1,95 @@
+#ifndef PROGRESSIVE_H_
+#define PROGRESSIVE_H_
+
+#include "triple.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Image;
+class Scene;
+
+// Progressive alternative to Scene::render. The image is refined in passes
+// and, while rendering, snapshots of the partial image are written at a
+// fixed interval, together with the accumulated samples to resume from.
+//
+// A pixel gets the same camera samples as in Scene::supersample, one per
+// pass, which are summed per pixel. The first sample is taken coarse to
+// fine: on every 8th pixel in both directions, then every 4th, every 2nd
+// and finally on the remaining pixels; snapshots fill the gaps with the
+// nearest pixel rendered. Every further pass adds the next sample to all
+// pixels. Without supersampling the final image is the same as that of
+// Scene::render.
+//
+// The number of samples of a pixel tells which passes it has done, so the
+// state can be saved at any moment and rendering resumed from it. The
+// Wavefront tracer and adaptive supersampling are not used.
+class Progressive
+{
+    Scene &d_scene;
+    unsigned d_width;
+    unsigned d_height;
+    unsigned d_samples;             // camera samples per pixel
+    std::uint64_t d_sceneHash;      // identifies the scene in state files
+
+    std::vector<Color> d_sums;      // per pixel: sum of its samples
+    std::vector<unsigned> d_counts; // per pixel: number of samples
+
+    // Snapshots of the image and of the state are written to these files
+    // (if not empty) every d_interval seconds.
+    std::string d_snapshotFile;
+    std::string d_stateFile;
+    double d_interval;
+    std::chrono::steady_clock::time_point d_lastSnapshot;
+
+    std::mutex d_lock;              // guards the sums, counts and snapshots
+
+    public:
+        // sceneText identifies the scene: a state saved for other scene
+        // text (or image size) is not resumed
+        Progressive(Scene &scene, unsigned width, unsigned height,
+                    std::string const &sceneText);
+
+        void setSnapshotFile(std::string const &filename);
+        void setStateFile(std::string const &filename);
+        void setInterval(double seconds);
+
+        // Continue from the state file. Returns false if there is none (or
+        // it belongs to another scene); rendering then starts afresh.
+        // Throws runtime_error if the file cannot be read.
+        bool resume();
+
+        unsigned numPasses() const;
+        unsigned long samplesDone() const;
+        unsigned long totalSamples() const;
+
+        // Render the remaining passes into img, which must have the size
+        // given to the constructor
+        void render(Image &img);
+
+        // number of samples per pixel (row major)
+        std::vector<unsigned> const &sampleCounts() const;
+
+    private:
+        // Whether pixel idx, at (x, y), still lacks the sample of pass
+        bool needs(unsigned pass, unsigned x, unsigned y, unsigned idx) const;
+
+        void renderPass(unsigned pass);
+
+        // camera sample index of pixel (x, y), as in Scene::supersample
+        Color sample(unsigned x, unsigned y, unsigned index) const;
+
+        // the image of the samples so far, gaps filled
+        void toImage(Image &img) const;
+
+        // write the snapshot and state files, with d_lock held
+        void snapshot();
+
+        // returns false if the state file cannot be written
+        bool saveState() const;
+};
+
+#endif
@@ -15,7 +15,7 @@ class Ray
             D(dir)
         {}
 
-        Point at(double t) const
+        Point at(Scalar t) const
         {
             return O + t * D;
         }
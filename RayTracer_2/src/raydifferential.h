@@ -0,0 +1,64 @@
+#ifndef RAYDIFFERENTIAL_H_
+#define RAYDIFFERENTIAL_H_
+
+#include "triple.h"
+
+// Ray differentials (Igehy 1999): how the origin and direction of a ray
+// change towards the rays through the neighbouring pixel samples in x and y.
+// They give the footprint of a pixel on the surface a ray hits, which
+// determines how much a texture must be filtered.
+class RayDifferential
+{
+    public:
+        Vector dOdx;
+        Vector dOdy;
+        Vector dDdx;
+        Vector dDdy;
+
+        // no footprint at all
+        RayDifferential() = default;
+
+        RayDifferential(Vector const &dOdx, Vector const &dOdy,
+                        Vector const &dDdx, Vector const &dDdy)
+        :
+            dOdx(dOdx),
+            dOdy(dOdy),
+            dDdx(dDdx),
+            dDdy(dDdy)
+        {}
+
+        // Offset of the hit point at distance t along direction D, on a
+        // surface with normal N, towards the neighbouring rays.
+        void transfer(Vector const &D, Scalar t, Vector const &N,
+                      Vector &dPdx, Vector &dPdy) const
+        {
+            Scalar DdotN = D.dot(N);
+            dPdx = dOdx + t * dDdx;
+            dPdy = dOdy + t * dDdy;
+            if (DdotN == 0.0)
+                return;     // grazing hit, keep the unprojected offsets
+            dPdx -= (dPdx.dot(N) / DdotN) * D;
+            dPdy -= (dPdy.dot(N) / DdotN) * D;
+        }
+
+        // Differentials of the ray reflected in a surface with normal N at
+        // a hit with offsets dPdx, dPdy. The curvature of the surface is
+        // ignored.
+        RayDifferential reflected(Vector const &N, Vector const &dPdx,
+                                  Vector const &dPdy) const
+        {
+            return RayDifferential(dPdx, dPdy,
+                                   dDdx - 2.0 * dDdx.dot(N) * N,
+                                   dDdy - 2.0 * dDdy.dot(N) * N);
+        }
+
+        // Differentials of the ray refracted with relative index of
+        // refraction eta (ni / nt), ignoring the curvature of the surface.
+        RayDifferential refracted(Scalar eta, Vector const &dPdx,
+                                  Vector const &dPdy) const
+        {
+            return RayDifferential(dPdx, dPdy, eta * dDdx, eta * dDdy);
+        }
+};
+
+#endif
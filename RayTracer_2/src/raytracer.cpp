@@ -1,14 +1,17 @@
 #include "raytracer.h"
 
+#include "animation.h"
 #include "image.h"
 #include "light.h"
 #include "material.h"
+#include "progressive.h"
 #include "triple.h"
 
 // =============================================================================
 // -- Include all your shapes here ---------------------------------------------
 // =============================================================================
 
+#include "shapes/mesh.h"
 #include "shapes/quad.h"
 #include "shapes/sphere.h"
 
@@ -18,14 +21,93 @@
 
 #include "json/json.h"
 
+#include <algorithm>
+#include <chrono>
 #include <exception>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <numeric>
+#include <sstream>
+#include <vector>
 
 using namespace std;        // no std:: required
 using json = nlohmann::json;
 
+namespace
+{
+    void printStatistics(Statistics const &stats)
+    {
+        // the tests per ray include the shadow rays
+        double rays = max(stats.total(), 1UL);
+
+        cout << "Rays: " << stats.primary << " primary, " << stats.shadow
+             << " shadow, " << stats.reflected << " reflected, "
+             << stats.refracted << " refracted.\n"
+             << "Recursion level: " << stats.averageLevel() << " on average, "
+             << stats.maxLevel << " at most.\n"
+             << "Tests per ray: " << stats.boxTests / rays << " boxes, "
+             << stats.primitiveTests / rays << " objects.\n"
+             << "Texture lookups: " << stats.textureLookups << ".\n";
+    }
+
+    // the position, rotation and scale of a mesh node
+    void readTransform(json const &node, Point &position, Vector &rotation,
+                       Vector &scale)
+    {
+        position = Point();
+        rotation = Vector();
+        scale = Vector(1, 1, 1);
+        if (node.count("position"))
+            position = Point(node["position"]);
+        if (node.count("rotation"))
+            rotation = Vector(node["rotation"]);
+        if (node.count("scale"))
+            scale = Vector(node["scale"]);
+    }
+
+    void writeStatistics(Statistics const &stats, string const &filename)
+    {
+        json node;
+        node["rays"] = {
+            {"primary", stats.primary},
+            {"shadow", stats.shadow},
+            {"reflected", stats.reflected},
+            {"refracted", stats.refracted}
+        };
+        node["tests"] = {
+            {"boxes", stats.boxTests},
+            {"primitives", stats.primitiveTests}
+        };
+        node["texture_lookups"] = stats.textureLookups;
+        node["recursion_level"] = {
+            {"average", stats.averageLevel()},
+            {"max", stats.maxLevel}
+        };
+
+        ofstream out(filename);
+        if (!out)
+            throw runtime_error("Could not open " + filename + " for writing.");
+        out << setw(4) << node << '\n';
+    }
+}
+
 bool Raytracer::parseObjectNode(json const &node)
+{
+    // keyframed meshes are moved instead of loaded again every frame
+    bool animated = node.count("keyframes") != 0;
+    ObjectPtr obj = createObject(animated ? Animation::at(node, 0) : node,
+                                 animated);
+    if (!obj)
+        return false;
+
+    scene.addObject(obj);
+    if (animated)
+        animation->add(Animation::OBJECT, scene.getNumObject() - 1, node);
+    return true;
+}
+
+ObjectPtr Raytracer::createObject(json const &node, bool movable)
 {
     ObjectPtr obj = nullptr;
 
@@ -57,6 +139,17 @@ bool Raytracer::parseObjectNode(json const &node)
         Point v3(node["v3"]);
         obj = ObjectPtr(new Quad(v0, v1, v2, v3));
     }
+    else if (node["type"] == "mesh")
+    {
+        string filename = node["filename"];
+        Point position;
+        Vector rotation;
+        Vector scale;
+        readTransform(node, position, rotation, scale);
+        Mesh *mesh = new Mesh(filename, position, rotation, scale, movable);
+        timings.build += mesh->buildTime();
+        obj = ObjectPtr(mesh);
+    }
     else
     {
         cerr << "Unknown object type: " << node["type"] << ".\n";
@@ -66,13 +159,20 @@ bool Raytracer::parseObjectNode(json const &node)
 // -- End of object reading ----------------------------------------------------
 // =============================================================================
 
-    if (!obj)
-        return false;
+    if (obj)
+        obj->material = parseMaterialNode(node["material"]);
+    return obj;
+}
 
-    // Parse material and add object to the scene
-    obj->material = parseMaterialNode(node["material"]);
-    scene.addObject(obj);
-    return true;
+void Raytracer::parseCameraNode(json const &node, Camera &camera) const
+{
+    Vector up(0, 1, 0);
+    double fov = 45;
+    if (node.count("up"))
+        up = Vector(node["up"]);
+    if (node.count("fov"))
+        fov = node["fov"];
+    camera.lookAt(Point(node["eye"]), Point(node["center"]), up, fov);
 }
 
 Light Raytracer::parseLightNode(json const &node) const
@@ -82,7 +182,7 @@ Light Raytracer::parseLightNode(json const &node) const
     return Light(pos, col);
 }
 
-Material Raytracer::parseMaterialNode(json const &node) const
+Material Raytracer::parseMaterialNode(json const &node)
 {
     double ka = node["ka"];
     double kd = node["kd"];
@@ -105,29 +205,61 @@ Material Raytracer::parseMaterialNode(json const &node) const
     if (node.count("texture"))
     {
         string imagePath = node["texture"];
-        Image im(imagePath);
-        return Material(im, ka, kd, ks, n);
+        return Material(textures.load(imagePath), ka, kd, ks, n);
     }
 
     // No color or texture specified
     return Material(Color(1, 0, 1), ka, kd, ks, n);
 }
 
+Raytracer::Raytracer() = default;
+
+Raytracer::~Raytracer() = default;
+
 bool Raytracer::readScene(string const &ifname)
 try
 {
+    auto start = chrono::steady_clock::now();
+    timings.build = 0;      // the BVHs of the meshes, added while parsing
+
     // Read and parse input json file
     ifstream infile(ifname);
     if (!infile) throw runtime_error("Could not open input file for reading.");
     json jsonscene;
     infile >> jsonscene;
+    sceneText = jsonscene.dump();
+    animation.reset(new Animation);
 
 // =============================================================================
 // -- Read your scene data in this section -------------------------------------
 // =============================================================================
 
-    Point eye(jsonscene["Eye"]);
-    scene.setEye(eye);
+    // Either a camera looking at a point, or the screen z = 0 seen from
+    // the eye (see camera.h)
+    Camera camera;
+    if (jsonscene.count("Camera"))
+    {
+        json const &node = jsonscene["Camera"];
+        if (node.count("keyframes"))
+        {
+            animation->add(Animation::CAMERA, 0, node);
+            parseCameraNode(Animation::at(node, 0), camera);
+        }
+        else
+            parseCameraNode(node, camera);
+    }
+    else
+        camera.setEye(Point(jsonscene["Eye"]));
+
+    if (jsonscene.count("Width") || jsonscene.count("Height"))
+    {
+        unsigned width = jsonscene.value("Width", camera.width());
+        unsigned height = jsonscene.value("Height", camera.height());
+        if (width == 0 || height == 0)
+            throw runtime_error("The image must be at least one pixel wide and high.");
+        camera.setSize(width, height);
+    }
+    scene.setCamera(camera);
 
     if (jsonscene.count("MaxRecursionDepth"))
     {
@@ -135,16 +267,20 @@ try
         scene.setRecursionDepth(depth);
     }
 
+    // 4^(factor - 1) rays per pixel
     if (jsonscene.count("SuperSamplingFactor"))
     {
         int factor = jsonscene["SuperSamplingFactor"];
+        if (factor < 1)
+            throw runtime_error("SuperSamplingFactor must be at least 1.");
         scene.setSuperSample(factor);
     }
 
-    if (jsonscene.count("SuperSamplingFactor"))
+    // Only supersample where neighbouring pixels differ more than this.
+    if (jsonscene.count("AdaptiveThreshold"))
     {
-        int factor = jsonscene["SuperSamplingFactor"];
-        scene.setSuperSample(factor);
+        double threshold = jsonscene["AdaptiveThreshold"];
+        scene.setAdaptiveSampling(threshold);
     }
 
     if (jsonscene.count("Shadows"))
@@ -153,15 +289,91 @@ try
         scene.setRenderShadows(shadows);
     }
 
+    if (jsonscene.count("Threads"))
+    {
+        unsigned threads = jsonscene["Threads"];
+        scene.setNumThreads(threads);
+    }
+
+    if (jsonscene.count("TileSize"))
+    {
+        unsigned size = jsonscene["TileSize"];
+        scene.setTileSize(size);
+    }
+
+    // Trace stage by stage instead of recursively (same image).
+    if (jsonscene.count("Wavefront"))
+    {
+        bool wavefront = jsonscene["Wavefront"];
+        scene.setUseWavefront(wavefront);
+    }
+
+    // "nearest" (default), "bilinear" or "trilinear"
+    if (jsonscene.count("TextureFilter"))
+    {
+        string filter = jsonscene["TextureFilter"];
+        if (filter == "nearest")
+            scene.setTextureFilter(Texture::NEAREST);
+        else if (filter == "bilinear")
+            scene.setTextureFilter(Texture::BILINEAR);
+        else if (filter == "trilinear")
+            scene.setTextureFilter(Texture::TRILINEAR);
+        else
+            throw runtime_error("Unknown TextureFilter: " + filter);
+    }
+
+    // How much slower refitting may make a BVH of an animation before it
+    // is rebuilt (see BVH::update)
+    if (jsonscene.count("RefitThreshold"))
+    {
+        double threshold = jsonscene["RefitThreshold"];
+        scene.setRefitThreshold(threshold);
+    }
+
+    // The BVH can be disabled to verify it against the linear search.
+    if (jsonscene.count("UseBVH"))
+    {
+        bool useBVH = jsonscene["UseBVH"];
+        scene.setUseBVH(useBVH);
+    }
+
     for (auto const &lightNode : jsonscene["Lights"])
-        scene.addLight(parseLightNode(lightNode));
+    {
+        if (lightNode.count("keyframes"))
+        {
+            scene.addLight(parseLightNode(Animation::at(lightNode, 0)));
+            animation->add(Animation::LIGHT, scene.getNumLights() - 1, lightNode);
+        }
+        else
+            scene.addLight(parseLightNode(lightNode));
+    }
 
     unsigned objCount = 0;
     for (auto const &objectNode : jsonscene["Objects"])
         if (parseObjectNode(objectNode))
             ++objCount;
 
-    cout << "Parsed " << objCount << " objects.\n";
+    cout << "Parsed " << objCount << " objects";
+    if (textures.size() != 0)
+        cout << " (" << textures.size() << " textures)";
+    cout << ".\n";
+
+    // Number of frames of an animation, by default up to the last keyframe
+    if (jsonscene.count("Frames"))
+    {
+        unsigned frames = jsonscene["Frames"];
+        animation->setNumFrames(max(frames, 1U));
+    }
+    if (!animation->empty())
+        cout << "Animated " << animation->tracks().size() << " parts of the scene over "
+             << animation->numFrames() << " frames.\n";
+
+    auto parsed = chrono::steady_clock::now();
+    scene.buildAccelerationStructure();
+
+    timings.parse = chrono::duration<double>(parsed - start).count() - timings.build;
+    timings.build += chrono::duration<double>(
+        chrono::steady_clock::now() - parsed).count();
 
 // =============================================================================
 // -- End of scene data reading ------------------------------------------------
@@ -175,13 +387,213 @@ catch (exception const &ex)
     return false;
 }
 
+unsigned Raytracer::getNumRebuilds() const
+{
+    return numRebuilds;
+}
+
+void Raytracer::setRefitThreshold(double threshold)
+{
+    scene.setRefitThreshold(threshold);
+}
+
+unsigned Raytracer::numFrames() const
+{
+    return animation ? animation->numFrames() : 1;
+}
+
+bool Raytracer::setFrame(unsigned newFrame)
+try
+{
+    auto start = chrono::steady_clock::now();
+    frame = newFrame;
+
+    vector<Mesh *> movedMeshes;
+    for (Animation::Track const &track : animation->tracks())
+    {
+        json node = Animation::at(track.node, frame);
+        switch (track.kind)
+        {
+            case Animation::OBJECT:
+                // Meshes only move, other objects are cheap to create anew
+                if (Mesh *mesh = dynamic_cast<Mesh *>(scene.getObject(track.index).get()))
+                {
+                    Point position;
+                    Vector rotation;
+                    Vector scale;
+                    readTransform(node, position, rotation, scale);
+                    mesh->setTransform(position, rotation, scale);
+                    movedMeshes.push_back(mesh);
+                }
+                else
+                    scene.setObject(track.index, createObject(node, false));
+                break;
+
+            case Animation::LIGHT:
+                scene.setLight(track.index, parseLightNode(node));
+                break;
+
+            case Animation::CAMERA:
+            {
+                Camera camera = scene.getCamera();
+                parseCameraNode(node, camera);
+                scene.setCamera(camera);
+                break;
+            }
+        }
+    }
+
+    // Refit the BVHs of the moved meshes and of the scene (or rebuild
+    // them once refitting has made them too slow)
+    auto updated = chrono::steady_clock::now();
+    for (Mesh *mesh : movedMeshes)
+        numRebuilds += mesh->updateBVH(scene.getRefitThreshold());
+    numRebuilds += scene.updateAccelerationStructure();
+
+    timings.update = chrono::duration<double>(updated - start).count();
+    timings.build = chrono::duration<double>(
+        chrono::steady_clock::now() - updated).count();
+    return true;
+}
+catch (exception const &ex)
+{
+    cerr << ex.what() << '\n';
+    return false;
+}
+
+void Raytracer::setNumThreads(unsigned threads)
+{
+    scene.setNumThreads(threads);
+}
+
+void Raytracer::setUseWavefront(bool use)
+{
+    scene.setUseWavefront(use);
+}
+
+void Raytracer::setSampleCountFile(string const &filename)
+{
+    sampleCountFile = filename;
+}
+
+void Raytracer::setStatisticsFile(string const &filename)
+{
+    statisticsFile = filename;
+}
+
+void Raytracer::setSize(unsigned width, unsigned height)
+{
+    Camera camera = scene.getCamera();
+    camera.setSize(width, height);
+    scene.setCamera(camera);
+}
+
+bool Raytracer::setRegion(unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+    Camera const &camera = scene.getCamera();
+    if (x0 >= x1 || y0 >= y1 || x1 > camera.width() || y1 > camera.height())
+        return false;
+
+    region = Region{x0, y0, x1, y1};
+    hasRegion = true;
+    return true;
+}
+
+void Raytracer::setProgressive(double interval)
+{
+    progressive = true;
+    snapshotInterval = interval;
+}
+
+void Raytracer::setStateFile(string const &filename)
+{
+    progressive = true;
+    stateFile = filename;
+}
+
+Scene const &Raytracer::getScene() const
+{
+    return scene;
+}
+
+Raytracer::Timings const &Raytracer::getTimings() const
+{
+    return timings;
+}
+
 void Raytracer::renderToFile(string const &ofname)
 {
-    // TODO: the size may be a settings in your file
-    Image img(400, 400);
-    cout << "Tracing...\n";
-    scene.render(img);
+    // the whole image of the camera, or the region given
+    Camera const &camera = scene.getCamera();
+    Region window = hasRegion ? region
+                              : Region{0, 0, camera.width(), camera.height()};
+    scene.setRegion(window.x0, window.y0);
+
+    Image img(window.x1 - window.x0, window.y1 - window.y0);
+    cout << "Tracing " << img.width() << " x " << img.height() << " pixels";
+    if (hasRegion)
+        cout << " of " << camera.width() << " x " << camera.height();
+    cout << "...\n";
+    vector<unsigned> sampleCounts;
+    auto start = chrono::steady_clock::now();
+    if (progressive)
+    {
+        // a state is only resumed for the same region of the same frame
+        ostringstream rendered;
+        rendered << sceneText << '\n' << camera.width() << 'x'
+                 << camera.height() << '+' << window.x0 << '+' << window.y0
+                 << " frame " << frame;
+
+        Progressive renderer(scene, img.width(), img.height(), rendered.str());
+        renderer.setSnapshotFile(ofname);
+        renderer.setInterval(snapshotInterval);
+        renderer.setStateFile(stateFile);
+        if (!stateFile.empty() && renderer.resume())
+            cout << "Resuming from " << stateFile << " ("
+                 << renderer.samplesDone() << " of "
+                 << renderer.totalSamples() << " samples done).\n";
+
+        renderer.render(img);
+        sampleCounts = renderer.sampleCounts();
+    }
+    else
+        scene.render(img, &sampleCounts);
+    timings.trace = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+
+    unsigned long total = accumulate(sampleCounts.begin(), sampleCounts.end(), 0UL);
+    unsigned maxCount = *max_element(sampleCounts.begin(), sampleCounts.end());
+    cout << "Traced " << total << " camera rays ("
+         << static_cast<double>(total) / sampleCounts.size() << " per pixel).\n";
+
+    if (Statistics::ENABLED)
+        printStatistics(scene.getStatistics());
+
+    if (!statisticsFile.empty())
+    {
+        if (!Statistics::ENABLED)
+            cerr << "Warning: statistics are not counted in this build "
+                    "(RAY_STATISTICS is off).\n";
+
+        cout << "Writing statistics to " << statisticsFile << "...\n";
+        writeStatistics(scene.getStatistics(), statisticsFile);
+    }
+
+    if (!sampleCountFile.empty())
+    {
+        Image counts(img.width(), img.height());
+        for (unsigned y = 0; y != img.height(); ++y)
+            for (unsigned x = 0; x != img.width(); ++x)
+                counts(x, y).set(sampleCounts[y * img.width() + x], maxCount);
+
+        cout << "Writing sample counts to " << sampleCountFile << "...\n";
+        counts.write_png(sampleCountFile);
+    }
+
     cout << "Writing image to " << ofname << "...\n";
+    start = chrono::steady_clock::now();
     img.write_png(ofname);
+    timings.encode = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
     cout << "Done.\n";
 }
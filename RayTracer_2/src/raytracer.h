@@ -2,10 +2,14 @@
 #define RAYTRACER_H_
 
 #include "scene.h"
+#include "texturecache.h"
 
+#include <memory>
 #include <string>
 
 // Forward declarations
+class Animation;
+class Camera;
 class Light;
 class Material;
 
@@ -13,19 +17,127 @@ class Material;
 
 class Raytracer
 {
-    Scene scene;
+    public:
+        // duration (in seconds) of the stages of readScene and renderToFile
+        struct Timings
+        {
+            double parse = 0;   // reading the scene file, textures and models
+            double update = 0;  // moving the animated parts to a frame
+            double build = 0;   // building the acceleration structures (of the
+                                // scene and the meshes)
+            double trace = 0;   // rendering the image
+            double encode = 0;  // writing the image to a PNG file
+        };
+
+    private:
+        Scene scene;
+        TextureCache textures;
+        Timings timings;
+
+        // if not empty, an image of the number of samples per pixel is
+        // written to this file
+        std::string sampleCountFile;
+
+        // if not empty, the statistics of the render are written to this
+        // file as JSON
+        std::string statisticsFile;
+
+        // Render progressively (see progressive.h), writing snapshots of
+        // the image every snapshotInterval seconds, and the state to
+        // resume from to stateFile if it is not empty.
+        bool progressive = false;
+        double snapshotInterval = 10;
+        std::string stateFile;
+
+        // the scene as read, identifies it in state files
+        std::string sceneText;
+
+        // the keyframed parts of the scene, and the current frame
+        std::unique_ptr<Animation> animation;
+        unsigned frame = 0;
+
+        // BVHs rebuilt instead of refitted by setFrame
+        unsigned numRebuilds = 0;
+
+        // If hasRegion, only this part of the image of the camera is
+        // rendered (and written).
+        struct Region
+        {
+            unsigned x0;    // first column
+            unsigned y0;    // first row
+            unsigned x1;    // one past the last column
+            unsigned y1;    // one past the last row
+        };
+        bool hasRegion = false;
+        Region region;
 
     public:
+        Raytracer();
+        ~Raytracer();
 
         bool readScene(std::string const &ifname);
         void renderToFile(std::string const &ofname);
 
+        // Number of frames of the animation of the scene (see animation.h),
+        // 1 if it is not animated.
+        unsigned numFrames() const;
+
+        // Move the keyframed objects, lights and camera to frame, and
+        // refit the BVHs of the scene and the moved meshes. The scene is
+        // at frame 0 after readScene. Textures and meshes are not loaded
+        // again.
+        bool setFrame(unsigned frame);
+
+        // number of BVHs setFrame rebuilt, as refitting made them too slow
+        unsigned getNumRebuilds() const;
+
+        // overrides the "RefitThreshold" of the scene file: the growth of
+        // the SAH cost of a refitted BVH at which it is rebuilt (see
+        // BVH::update), negative to rebuild every frame
+        void setRefitThreshold(double threshold);
+
+        // overrides the number of threads given in the scene file
+        void setNumThreads(unsigned threads);
+
+        // overrides the choice of tracer given in the scene file
+        void setUseWavefront(bool use);
+
+        // write the number of samples per pixel as a grey scale image
+        void setSampleCountFile(std::string const &filename);
+
+        // write the statistics of the render (see statistics.h) as JSON
+        void setStatisticsFile(std::string const &filename);
+
+        // overrides the image size given in the scene file
+        void setSize(unsigned width, unsigned height);
+
+        // Only render columns x0 up to x1 and rows y0 up to y1 (from the
+        // top) of the image, into an image of that size. Returns false if
+        // the region is empty or not inside the image; call after setSize.
+        bool setRegion(unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+
+        // render progressively, with a snapshot every interval seconds
+        void setProgressive(double interval);
+
+        // save the progressive render to filename, and resume from it if
+        // it exists (implies progressive rendering)
+        void setStateFile(std::string const &filename);
+
+        Scene const &getScene() const;
+        Timings const &getTimings() const;
+
     private:
 
         bool parseObjectNode(nlohmann::json const &node);
 
+        // the object of node with its material, nullptr if its type is
+        // unknown; a movable mesh can be moved (see Mesh::setTransform)
+        ObjectPtr createObject(nlohmann::json const &node, bool movable);
+
+        void parseCameraNode(nlohmann::json const &node, Camera &camera) const;
+
         Light parseLightNode(nlohmann::json const &node) const;
-        Material parseMaterialNode(nlohmann::json const &node) const;
+        Material parseMaterialNode(nlohmann::json const &node);
 };
 
 #endif
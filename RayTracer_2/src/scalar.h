@@ -0,0 +1,13 @@
+#ifndef SCALAR_H_
+#define SCALAR_H_
+
+// Floating point type of the geometry and shading code. CMake builds the
+// ray tracer twice from the same sources: `ray` in double precision and
+// `ray_float`, with RAY_SINGLE_PRECISION defined, in single precision.
+#ifdef RAY_SINGLE_PRECISION
+typedef float Scalar;
+#else
+typedef double Scalar;
+#endif
+
+#endif
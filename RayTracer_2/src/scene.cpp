@@ -4,48 +4,135 @@
 #include "image.h"
 #include "material.h"
 #include "ray.h"
+#include "tilescheduler.h"
+#include "wavefront.h"
 
 #include <algorithm>
 #include <cmath>
+#include <functional>
 #include <limits>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
 
 using namespace std;
 
-pair<ObjectPtr, Hit> Scene::castRay(Ray const &ray) const
+HitRecord Scene::castRay(Ray const &ray) const
+{
+    HitRecord record;
+    Hit other = Hit::NO_HIT();
+    record.prim = closestHit(ray, record.t, other);
+
+    // No hit
+    if (record.prim == objects.size())
+    {
+        record.prim = HitRecord::NONE;
+        return record;
+    }
+
+    record.N = primitives.normal(record.prim, ray, record.t, other, record.part);
+
+    Object &obj = *objects[record.prim];
+    if (obj.material.hasTexture)
+        record.uv = obj.toUV(ray.at(record.t), record.part);
+    return record;
+}
+
+unsigned Scene::closestHit(Ray const &ray, Scalar &t, Hit &other) const
 {
     // Find hit object and distance
-    Hit min_hit(numeric_limits<double>::infinity(), Vector());
-    ObjectPtr obj = nullptr;
-    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    Scalar tMax = numeric_limits<Scalar>::infinity();
+    unsigned minIdx = objects.size();
+
+    if (useBVH)
     {
-        Hit hit(objects[idx]->intersect(ray));
-        if (hit.t < min_hit.t)
+        // Equally close hits are resolved in favour of the lowest object
+        // index, so the result does not depend on the traversal order.
+        unsigned tests = 0;
+        Hit hit = Hit::NO_HIT();
+        auto visit = [&](unsigned idx, Scalar &tMax)
         {
-            min_hit = hit;
-            obj = objects[idx];
-        }
+            STAT_COUNT(tests);
+            Scalar t = primitives.intersect(idx, ray, hit);
+            if (t < tMax || (t == tMax && idx < minIdx))
+            {
+                tMax = t;
+                minIdx = idx;
+                other = hit;
+            }
+            return false;   // continue the search
+        };
+
+        unsigned boxTests = bvh.traverse(ray, tMax, [&](unsigned prim, Scalar &tMax)
+        {
+            return visit(boundedObjects[prim], tMax);
+        });
+        for (unsigned idx : unboundedObjects)
+            visit(idx, tMax);
+
+        STAT_ADD(boxTests, boxTests);
+        STAT_ADD(primitiveTests, tests);
+    }
+    else
+    {
+        primitives.closestHit(ray, tMax, minIdx, other);
+        STAT_ADD(primitiveTests, objects.size());
+    }
+
+    t = tMax;
+    return minIdx;
+}
+
+bool Scene::occluded(Ray const &ray, Scalar maxT) const
+{
+    unsigned tests = 0;
+    if (!useBVH)
+    {
+        bool hit = primitives.anyHit(ray, maxT, tests);
+        STAT_ADD(primitiveTests, tests);
+        return hit;
+    }
+
+    // Stop at the first object found within range
+    bool hit = false;
+    unsigned boxTests = bvh.traverse(ray, maxT, [&](unsigned prim, Scalar &maxT)
+    {
+        STAT_COUNT(tests);
+        hit = primitives.intersectAny(boundedObjects[prim], ray, maxT);
+        return hit;
+    });
+
+    for (unsigned idx = 0; !hit && idx != unboundedObjects.size(); ++idx)
+    {
+        STAT_COUNT(tests);
+        hit = primitives.intersectAny(unboundedObjects[idx], ray, maxT);
     }
 
-    return pair<ObjectPtr, Hit>(obj, min_hit);
+    STAT_ADD(boxTests, boxTests);
+    STAT_ADD(primitiveTests, tests);
+    return hit;
 }
 
-Color Scene::trace(Ray const &ray, unsigned depth, bool inside)
+Color Scene::trace(Ray const &ray, unsigned depth, bool inside,
+                   RayDifferential const &diff)
 {
-    pair<ObjectPtr, Hit> mainhit = castRay(ray);
-    ObjectPtr obj = mainhit.first;
-    Hit min_hit = mainhit.second;
+    STAT_ADD(levelSum, recursionDepth - depth);
+    STAT_MAX(maxLevel, recursionDepth - depth);
+
+    HitRecord record = castRay(ray);
 
     // No hit? Return background color.
-    if (!obj)
+    if (!record.isHit())
         return Color(0.0, 0.0, 0.0);
 
-    Material const &material = obj->material;
-    Point hit = ray.at(min_hit.t);
+    Scalar t = record.t;
+    Object &obj = *objects[record.prim];
+    Material const &material = obj.material;
+    Point hit = ray.at(t);
     Vector V = -ray.D;
 
     // Pre-condition: For closed objects, N points outwards.
-    Vector N = min_hit.N;
+    Vector const &N = record.N;
 
     // The shading normal always points in the direction of the view,
     // as required by the Phong illumination model.
@@ -54,87 +141,174 @@ Color Scene::trace(Ray const &ray, unsigned depth, bool inside)
         shadingN = N;
     else
         shadingN = -N;
-	
-	Color matColor;
-
-	if (material.hasTexture) {
-		Vector temp = obj->toUV(hit);
-		float u = temp.x;
-		float v = temp.y;
-		matColor = material.texture.colorAt(u, 1.0 - v);
-	} else {
-	    matColor = material.color;
-	}
+
+    // Footprint of the pixel on the surface
+    Vector dPdx;
+    Vector dPdy;
+    diff.transfer(ray.D, t, N, dPdx, dPdy);
+
+    Color matColor = materialColor(obj, record, hit, dPdx, dPdy);
+
+    // Offset of secondary ray origins from the surface
+    Scalar offset = primitives.offset(record.prim, hit, epsilon);
+
     // Add ambient once, regardless of the number of lights.
     Color color = material.ka * matColor;
 
     // Add diffuse and specular components.
     for (auto const &light : lights) {
-        Vector L = (light->position - hit).normalized();
-
         if (renderShadows) {
-
-            Ray shadowRay(hit + epsilon * shadingN, (light->position - (hit + epsilon * shadingN)).normalized());
-            pair<ObjectPtr, Hit> shadowHit = castRay(shadowRay);
-            if (shadowHit.second.t < (light->position - (hit + epsilon * shadingN)).length()) {
+            Point shadowOrigin = hit + offset * shadingN;
+            Vector toLight = light->position - shadowOrigin;
+            Ray shadowRay(shadowOrigin, toLight.normalized());
+            STAT_ADD(shadow, 1);
+            if (occluded(shadowRay, toLight.length())) {
                 continue;
             }
         }
-        
-        // Add diffuse.
-        double diffuse = std::max(shadingN.dot(L), 0.0);
-        color += diffuse * material.kd * light->color * matColor;
-
-        // Add specular.
-        Vector reflectDir = reflect(-L, shadingN);
-        double specAngle = std::max(reflectDir.dot(V), 0.0);
-        double specular = std::pow(specAngle, material.n);
 
-        color += specular * material.ks * light->color;
+        Color diffuse;
+        Color specular;
+        lightTerms(*light, material, matColor, hit, shadingN, V, diffuse, specular);
+        color += diffuse;
+        color += specular;
     }
 
     if (depth > 0 && material.isTransparent)
     {
         // The object is transparent, and thus refracts and reflects light.
-        // Use Schlick's approximation to determine the ratio between the two.
-        Ray reflectRay(hit + epsilon * shadingN, reflect(ray.D, shadingN));
-		
-		double ni, nt;
-
-		if (not inside) {
-			ni = 1.0;
-        	nt = material.nt;
-		} else {
-			ni = material.nt;
-        	nt = 1.0;
-		}
-
-        double k = 1.0 - ni*ni*(1.0 - pow((ray.D).dot(shadingN), 2)) / (nt*nt);
-
-        Vector T(0, 0, 0);
-        if (k >= 0.0) {
-            T = ni * (ray.D - (ray.D).dot(shadingN) * shadingN) / nt;
-            T -= shadingN * sqrt(k);
-        }
+        Ray reflectRay(hit + offset * shadingN, reflect(ray.D, shadingN));
 
-        double kr0 = pow((ni-nt)/(ni+nt), 2);
-        double kr = kr0 + (1.0 - kr0) * pow((1.0 - ((-ray.D).dot(shadingN))), 5);
-        double kt = 1.0 - kr;
+        Vector T;
+        Scalar kr;
+        Scalar kt;
+        refraction(ray.D, shadingN, material, inside, T, kr, kt);
 
-        Ray refractRay(hit - epsilon * shadingN, T.normalized());
+        Ray refractRay(hit - offset * shadingN, T.normalized());
 
-    	color += kr * trace(reflectRay, depth-1, inside) + kt * trace(refractRay, depth-1, not inside);
+        RayDifferential reflectDiff = diff.reflected(shadingN, dPdx, dPdy);
+        Scalar eta = inside ? material.nt : 1.0 / material.nt;
+        RayDifferential refractDiff = diff.refracted(eta, dPdx, dPdy);
+
+        STAT_ADD(reflected, 1);
+        STAT_ADD(refracted, 1);
+    	color += kr * trace(reflectRay, depth-1, inside, reflectDiff) + kt * trace(refractRay, depth-1, not inside, refractDiff);
     }
     else if (depth > 0 && material.ks > 0.0)
     {
-        Ray reflectRay(hit + epsilon * shadingN, reflect(ray.D, shadingN));
-        color += material.ks * trace(reflectRay, depth-1, inside);
+        Ray reflectRay(hit + offset * shadingN, reflect(ray.D, shadingN));
+        RayDifferential reflectDiff = diff.reflected(shadingN, dPdx, dPdy);
+        STAT_ADD(reflected, 1);
+        color += material.ks * trace(reflectRay, depth-1, inside, reflectDiff);
     }
 
     return color;
 }
 
-Color Scene::supersample(double x, double y, bool inside, double shift, unsigned ssr) {
+unsigned Scene::samplesPerPixel() const
+{
+    return 1U << 2 * (supersamplingFactor - 1);
+}
+
+Scalar Scene::screenX(unsigned x) const
+{
+    return regionX + x + 0.5;
+}
+
+Scalar Scene::screenY(unsigned y) const
+{
+    return camera.height() - 1 - (regionY + y) + 0.5;
+}
+
+RayDifferential Scene::cameraDifferential(Scalar x, Scalar y, Scalar spacing,
+                                          Vector const &D) const
+{
+    Vector dDdx = camera.direction(x + spacing, y) - D;
+    Vector dDdy = camera.direction(x, y + spacing) - D;
+    return RayDifferential(Vector(), Vector(), dDdx, dDdy);
+}
+
+Color Scene::materialColor(Object &obj, HitRecord const &record,
+                           Point const &hit, Vector const &dPdx,
+                           Vector const &dPdy) const
+{
+    Material const &material = obj.material;
+    if (!material.hasTexture)
+        return material.color;
+
+    STAT_ADD(textureLookups, 1);
+
+    // The uv of the hit itself was computed once by castRay. Only the
+    // trilinear filter needs the footprint, and thus more toUV calls.
+    Vector const &uv = record.uv;
+    float u = uv.x;
+    float v = uv.y;
+    if (textureFilter != Texture::TRILINEAR)
+        return material.texture->sample(u, 1.0 - v, Vector(), Vector(),
+                                        textureFilter);
+
+    // Change of the texture coordinates over the footprint. Coordinates
+    // wrap around (as u does on a sphere), so take the shortest way.
+    auto wrapped = [](Vector duv)
+    {
+        duv.x -= std::round(duv.x);
+        duv.y = -(duv.y - std::round(duv.y));   // v is flipped, as above
+        return duv;
+    };
+    Vector dx = wrapped(obj.toUV(hit + dPdx, record.part) - uv);
+    Vector dy = wrapped(obj.toUV(hit + dPdy, record.part) - uv);
+
+    return material.texture->sample(u, 1.0 - v, dx, dy, textureFilter);
+}
+
+void Scene::lightTerms(Light const &light, Material const &material,
+                       Color const &matColor, Point const &hit,
+                       Vector const &N, Vector const &V,
+                       Color &diffuseTerm, Color &specularTerm) const
+{
+    Vector L = (light.position - hit).normalized();
+
+    // Diffuse.
+    Scalar diffuse = std::max(N.dot(L), Scalar(0.0));
+    diffuseTerm = diffuse * material.kd * light.color * matColor;
+
+    // Specular.
+    Vector reflectDir = reflect(-L, N);
+    Scalar specAngle = std::max(reflectDir.dot(V), Scalar(0.0));
+    Scalar specular = std::pow(specAngle, material.n);
+    specularTerm = specular * material.ks * light.color;
+}
+
+void Scene::refraction(Vector const &D, Vector const &N,
+                       Material const &material, bool inside,
+                       Vector &T, Scalar &kr, Scalar &kt) const
+{
+    // Use Schlick's approximation to determine the ratio between
+    // reflection and refraction.
+    Scalar ni, nt;
+
+    if (not inside) {
+        ni = 1.0;
+        nt = material.nt;
+    } else {
+        ni = material.nt;
+        nt = 1.0;
+    }
+
+    Scalar k = 1.0 - ni*ni*(1.0 - pow(D.dot(N), 2)) / (nt*nt);
+
+    T = Vector(0, 0, 0);
+    if (k >= 0.0) {
+        T = ni * (D - D.dot(N) * N) / nt;
+        T -= N * sqrt(k);
+    }
+
+    Scalar kr0 = pow((ni-nt)/(ni+nt), 2);
+    kr = kr0 + (1.0 - kr0) * pow((1.0 - ((-D).dot(N))), 5);
+    kt = 1.0 - kr;
+}
+
+Color Scene::supersample(Scalar x, Scalar y, bool inside, Scalar shift, unsigned ssr) {
 	Color col;
     if (ssr != 1) {
         col = supersample(x - shift, y + shift, inside, shift/2.0, ssr-1);
@@ -143,25 +317,208 @@ Color Scene::supersample(double x, double y, bool inside, double shift, unsigned
         col += supersample(x - shift, y - shift, inside, shift/2.0, ssr-1);
         col /= 4; 
     } else { // ssr == 1
-        Point pixel(x, y, 0);
-		Ray ray(eye, (pixel - eye).normalized());
-        col = trace(ray, recursionDepth, inside);
+        // samples are 4 * shift apart (a pixel without supersampling)
+        col = sample(x, y, inside, 4 * shift);
     }
     return col;
-} 
+}
+
+Color Scene::sample(Scalar x, Scalar y, bool inside, Scalar spacing)
+{
+    Ray ray(camera.eye(), camera.direction(x, y));
+    STAT_ADD(primary, 1);
+    return trace(ray, recursionDepth, inside,
+                 cameraDifferential(x, y, spacing, ray.D));
+}
+
+namespace
+{
+    // largest difference of a color channel between pixel (x, y) and its
+    // (at most eight) neighbours
+    Scalar contrast(Image const &img, unsigned x, unsigned y)
+    {
+        Color const &center = img(x, y);
+        Scalar result = 0.0;
+        for (unsigned ny = max(y, 1U) - 1; ny <= min(y + 1, img.height() - 1); ++ny)
+            for (unsigned nx = max(x, 1U) - 1; nx <= min(x + 1, img.width() - 1); ++nx)
+            {
+                Color diff = img(nx, ny) - center;
+                result = max(result, max(abs(diff.r), max(abs(diff.g), abs(diff.b))));
+            }
+        return result;
+    }
+}
 
-void Scene::render(Image &img)
+void Scene::render(Image &img, vector<unsigned> *sampleCounts)
 {
     unsigned w = img.width();
     unsigned h = img.height();
 
-    for (unsigned y = 0; y < h; ++y)
-        for (unsigned x = 0; x < w; ++x)
+    unsigned samples = samplesPerPixel();
+
+    // Every pixel is computed independently of the others, so the result
+    // does not depend on the number of threads or the order of the tiles.
+    TileScheduler scheduler(w, h, tileSize, numThreads);
+    Wavefront wavefront(*this);
+
+    // Run renderTile for all tiles of scheduler, adding the statistics of
+    // every tile to stats.
+    stats = Statistics();
+    mutex statsLock;
+    auto runTiles = [&](TileScheduler &scheduler,
+                        function<void(TileScheduler::Tile const &)> const &renderTile)
+    {
+        scheduler.run([&](TileScheduler::Tile const &tile)
+        {
+            Statistics &local = Statistics::local();
+            local = Statistics();
+            renderTile(tile);
+
+            lock_guard<mutex> guard(statsLock);
+            stats += local;
+        });
+    };
+
+    auto renderPixels = [&](Image &target, vector<Wavefront::Pixel> const &pixels,
+                            unsigned ssr)
+    {
+        if (useWavefront)
         {
-            Color col = supersample(x + 0.5, h - 1 - y + 0.5, false, 0.25, supersamplingFactor);
+            wavefront.render(target, pixels, ssr);
+            return;
+        }
+
+        for (Wavefront::Pixel const &pixel : pixels)
+        {
+            Color col = supersample(screenX(pixel.x), screenY(pixel.y), false, 0.25, ssr);
             col.clamp();
-            img(x, y) = col;
+            target(pixel.x, pixel.y) = col;
+        }
+    };
+
+    auto tilePixels = [](TileScheduler::Tile const &tile)
+    {
+        vector<Wavefront::Pixel> pixels;
+        for (unsigned y = tile.y0; y < tile.y1; ++y)
+            for (unsigned x = tile.x0; x < tile.x1; ++x)
+                pixels.push_back(Wavefront::Pixel{x, y});
+        return pixels;
+    };
+
+    if (!adaptive || supersamplingFactor <= 1)
+    {
+        runTiles(scheduler, [&](TileScheduler::Tile const &tile)
+        {
+            renderPixels(img, tilePixels(tile), supersamplingFactor);
+        });
+
+        if (sampleCounts)
+            sampleCounts->assign(w * h, samples);
+        return;
+    }
+
+    // Adaptive: sample every pixel once, at its center. The pixels around
+    // a region (within the image of the camera) are sampled as well, so
+    // the pixels at its edges are compared with the same neighbours as in
+    // the full image, and regions add up to the full image.
+    unsigned left = min(regionX, 1U);
+    unsigned top = min(regionY, 1U);
+    unsigned right = regionX + w < camera.width() ? 1 : 0;
+    unsigned bottom = regionY + h < camera.height() ? 1 : 0;
+    Image coarse(left + w + right, top + h + bottom);
+    TileScheduler coarseScheduler(coarse.width(), coarse.height(), tileSize,
+                                  numThreads);
+
+    regionX -= left;    // the pixels of coarse
+    regionY -= top;
+    runTiles(coarseScheduler, [&](TileScheduler::Tile const &tile)
+    {
+        renderPixels(coarse, tilePixels(tile), 1);
+    });
+    regionX += left;
+    regionY += top;
+
+    for (unsigned y = 0; y != h; ++y)
+        for (unsigned x = 0; x != w; ++x)
+            img(x, y) = coarse(left + x, top + y);
+
+    // then supersample the pixels which differ from their neighbours
+    vector<unsigned> counts(w * h, 1);
+    runTiles(scheduler, [&](TileScheduler::Tile const &tile)
+    {
+        vector<Wavefront::Pixel> pixels;
+        for (Wavefront::Pixel const &pixel : tilePixels(tile))
+            if (contrast(coarse, left + pixel.x, top + pixel.y) > adaptiveThreshold)
+            {
+                pixels.push_back(pixel);
+                counts[pixel.y * w + pixel.x] += samples;
+            }
+        renderPixels(img, pixels, supersamplingFactor);
+    });
+
+    if (sampleCounts)
+        sampleCounts->swap(counts);
+}
+
+void Scene::buildAccelerationStructure()
+{
+    primitives.build(objects);
+
+    bvh.clear();
+    boundedObjects.clear();
+    unboundedObjects.clear();
+
+    if (!useBVH)
+        return;
+
+    vector<AABB> boxes;
+    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    {
+        AABB box = objects[idx]->boundingBox();
+        if (box.isFinite())
+        {
+            boxes.push_back(box);
+            boundedObjects.push_back(idx);
         }
+        else
+            unboundedObjects.push_back(idx);
+    }
+
+    bvh.build(boxes);
+    cout << "Built BVH over " << boundedObjects.size() << " objects ("
+         << bvh.numNodes() << " nodes, " << unboundedObjects.size()
+         << " unbounded objects).\n";
+}
+
+bool Scene::updateAccelerationStructure()
+{
+    primitives.build(objects);
+    if (!useBVH)
+        return false;
+
+    vector<AABB> boxes;
+    boxes.reserve(boundedObjects.size());
+    for (unsigned idx : boundedObjects)
+        boxes.push_back(objects[idx]->boundingBox());
+
+    // The BVH can only be refitted to the same bounded objects
+    bool sameObjects =
+        boundedObjects.size() + unboundedObjects.size() == objects.size()
+        && all_of(boxes.begin(), boxes.end(),
+                  [](AABB const &box) { return box.isFinite(); })
+        && none_of(unboundedObjects.begin(), unboundedObjects.end(),
+                   [&](unsigned idx) { return objects[idx]->boundingBox().isFinite(); });
+    if (!sameObjects)
+    {
+        buildAccelerationStructure();
+        return true;
+    }
+
+    bool rebuilt = bvh.update(boxes, refitThreshold);
+    cout << (rebuilt ? "Rebuilt" : "Refitted") << " BVH over "
+         << boundedObjects.size() << " objects (SAH cost " << bvh.cost()
+         << ").\n";
+    return rebuilt;
 }
 
 // --- Misc functions ----------------------------------------------------------
@@ -171,10 +528,20 @@ Scene::Scene()
 :
     objects(),
     lights(),
-    eye(),
+    camera(),
+    regionX(0),
+    regionY(0),
     renderShadows(false),
     recursionDepth(0),
-    supersamplingFactor(1)
+    supersamplingFactor(1),
+    numThreads(0),
+    tileSize(16),
+    useWavefront(false),
+    adaptive(false),
+    adaptiveThreshold(0.0),
+    textureFilter(Texture::NEAREST),
+    useBVH(true),
+    refitThreshold(0.25)
 {}
 
 void Scene::addObject(ObjectPtr obj)
@@ -187,21 +554,57 @@ void Scene::addLight(Light const &light)
     lights.push_back(LightPtr(new Light(light)));
 }
 
-void Scene::setEye(Triple const &position)
+void Scene::setObject(unsigned idx, ObjectPtr obj)
+{
+    objects[idx] = obj;
+}
+
+void Scene::setLight(unsigned idx, Light const &light)
 {
-    eye = position;
+    lights[idx] = LightPtr(new Light(light));
 }
 
-unsigned Scene::getNumObject()
+void Scene::setCamera(Camera const &newCamera)
+{
+    camera = newCamera;
+}
+
+void Scene::setRegion(unsigned x0, unsigned y0)
+{
+    regionX = x0;
+    regionY = y0;
+}
+
+unsigned Scene::getNumObject() const
 {
     return objects.size();
 }
 
-unsigned Scene::getNumLights()
+unsigned Scene::getNumLights() const
 {
     return lights.size();
 }
 
+ObjectPtr const &Scene::getObject(unsigned idx) const
+{
+    return objects[idx];
+}
+
+Statistics const &Scene::getStatistics() const
+{
+    return stats;
+}
+
+Camera const &Scene::getCamera() const
+{
+    return camera;
+}
+
+Scalar Scene::getRefitThreshold() const
+{
+    return refitThreshold;
+}
+
 void Scene::setRenderShadows(bool shadows)
 {
     renderShadows = shadows;
@@ -214,5 +617,43 @@ void Scene::setRecursionDepth(unsigned depth)
 
 void Scene::setSuperSample(unsigned factor)
 {
+    if (factor == 0)
+        throw runtime_error("The supersampling factor must be at least 1.");
     supersamplingFactor = factor;
 }
+
+void Scene::setUseBVH(bool use)
+{
+    useBVH = use;
+}
+
+void Scene::setNumThreads(unsigned threads)
+{
+    numThreads = threads;
+}
+
+void Scene::setTileSize(unsigned size)
+{
+    tileSize = size;
+}
+
+void Scene::setUseWavefront(bool use)
+{
+    useWavefront = use;
+}
+
+void Scene::setAdaptiveSampling(Scalar threshold)
+{
+    adaptive = true;
+    adaptiveThreshold = threshold;
+}
+
+void Scene::setTextureFilter(Texture::Filter filter)
+{
+    textureFilter = filter;
+}
+
+void Scene::setRefitThreshold(Scalar threshold)
+{
+    refitThreshold = threshold;
+}
@@ -1,12 +1,18 @@
 #ifndef SCENE_H_
 #define SCENE_H_
 
+#include "bvh.h"
+#include "camera.h"
+#include "hitrecord.h"
 #include "light.h"
 #include "object.h"
+#include "primitivestore.h"
+#include "raydifferential.h"
+#include "statistics.h"
+#include "texture.h"
 #include "triple.h"
 
 #include <vector>
-#include <utility>
 
 // Forward declarations
 class Ray;
@@ -16,40 +22,162 @@ class Scene
 {
     std::vector<ObjectPtr> objects;
     std::vector<LightPtr> lights;
-    Point eye;
+    Camera camera;
+
+    // Top left pixel, in the image of the camera, of the image rendered:
+    // render renders the region of the size of the image given to it.
+    unsigned regionX;
+    unsigned regionY;
+
     bool renderShadows;
     unsigned recursionDepth;
     unsigned supersamplingFactor;
 
+    // Rendering is done in tiles of tileSize x tileSize pixels on numThreads
+    // threads (0: one per hardware thread).
+    unsigned numThreads;
+    unsigned tileSize;
+
+    // Render with the iterative Wavefront tracer instead of trace.
+    bool useWavefront;
+
+    // Adaptive supersampling: every pixel is first sampled once, only
+    // pixels whose color differs by more than adaptiveThreshold (in some
+    // channel) from a neighbour are supersampled.
+    bool adaptive;
+    Scalar adaptiveThreshold;
+
+    // Filtering of texture lookups. Other than NEAREST, the footprint of
+    // the pixel on the surface is estimated from ray differentials.
+    Texture::Filter textureFilter;
+
+    // Work done by the last call of render (see statistics.h)
+    Statistics stats;
+
+    // Packed geometry of the objects, used for all intersection tests.
+    PrimitiveStore primitives;
+
+    // Acceleration structure. The BVH refers to boundedObjects, which holds
+    // indices into objects; unbounded objects are tested for every ray.
+    bool useBVH;
+    BVH bvh;
+    std::vector<unsigned> boundedObjects;
+    std::vector<unsigned> unboundedObjects;
+
+    // updateAccelerationStructure refits the BVH to moved objects, unless
+    // that makes its SAH cost grow by more than this fraction (see
+    // BVH::update). Negative: always rebuild.
+    Scalar refitThreshold;
+
     // Offset multiplier. Before casting a new ray from a hit point,
     // move the hit point in the direction of the normal with this offset
     // to prevent finding an intersection with the same object due to
     // floating point inaccuracies. This prevents shadow acne, among other problems.
-    double const epsilon = 1E-3;
+    // This is the minimum: primitives.offset() enlarges it for hits with
+    // large coordinates.
+    Scalar const epsilon = 1E-3;
 
     public:
         Scene();
 
         // determine closest hit (if any)
-        std::pair<ObjectPtr, Hit> castRay(Ray const &ray) const;
+        HitRecord castRay(Ray const &ray) const;
+
+        // determine whether anything is hit before maxT (shadow rays)
+        bool occluded(Ray const &ray, Scalar maxT) const;
 
         // trace a ray into the scene and return the color
-		Color supersample(double x, double y, bool inside, double shift, unsigned ssr);
-        Color trace(Ray const &ray, unsigned depth, bool inside);
+		Color supersample(Scalar x, Scalar y, bool inside, Scalar shift, unsigned ssr);
+        Color trace(Ray const &ray, unsigned depth, bool inside,
+                    RayDifferential const &diff = RayDifferential());
+
+        // Render the scene to the given image. If sampleCounts is given,
+        // it receives the number of camera rays traced per pixel (row major).
+        void render(Image &img, std::vector<unsigned> *sampleCounts = nullptr);
 
-        // render the scene to the given image
-        void render(Image &img);
+        // (re)build the acceleration structure, call after adding objects
+        void buildAccelerationStructure();
 
+        // Update the acceleration structure to objects replaced by setObject
+        // (or moved): refit or rebuild it, see refitThreshold. Returns
+        // whether it was rebuilt.
+        bool updateAccelerationStructure();
 
         void addObject(ObjectPtr obj);
         void addLight(Light const &light);
-        void setEye(Triple const &position);
+
+        // replace object or light idx (for animation); call
+        // buildAccelerationStructure after replacing objects
+        void setObject(unsigned idx, ObjectPtr obj);
+        void setLight(unsigned idx, Light const &light);
+        void setCamera(Camera const &camera);
+        void setRegion(unsigned x0, unsigned y0);
         void setRenderShadows(bool renderShadows);
         void setRecursionDepth(unsigned depth);
+        // factor >= 1 (one ray per pixel), throws runtime_error otherwise
         void setSuperSample(unsigned factor);
+        void setUseBVH(bool use);
+        void setNumThreads(unsigned threads);
+        void setTileSize(unsigned size);
+        void setUseWavefront(bool use);
+        void setAdaptiveSampling(Scalar threshold);
+        void setTextureFilter(Texture::Filter filter);
+        void setRefitThreshold(Scalar threshold);
+
+        unsigned getNumObject() const;
+        unsigned getNumLights() const;
+        ObjectPtr const &getObject(unsigned idx) const;
+        Statistics const &getStatistics() const;
+        Camera const &getCamera() const;
+        Scalar getRefitThreshold() const;
+
+    private:
+        // index of the closest object hit and the distance t to it,
+        // objects.size() if nothing is hit; other as for
+        // PrimitiveStore::intersect
+        unsigned closestHit(Ray const &ray, Scalar &t, Hit &other) const;
+
+        // --- Shading, shared by trace and the Wavefront tracer ---
+
+        // camera rays per supersampled pixel: 4^(supersamplingFactor - 1)
+        unsigned samplesPerPixel() const;
+
+        // screen coordinates (see camera.h) of the center of pixel (x, y)
+        // of the image rendered
+        Scalar screenX(unsigned x) const;
+        Scalar screenY(unsigned y) const;
+
+        // differentials of the camera ray with direction D through (x, y),
+        // towards samples spacing pixels away
+        RayDifferential cameraDifferential(Scalar x, Scalar y, Scalar spacing,
+                                           Vector const &D) const;
+
+        // color of the material of obj at hit (texture or plain color),
+        // with the texture coordinates and part of record; dPdx and dPdy
+        // span the footprint of the pixel
+        Color materialColor(Object &obj, HitRecord const &record,
+                            Point const &hit, Vector const &dPdx,
+                            Vector const &dPdy) const;
+
+        // diffuse and specular light from light reflected towards V by a
+        // surface with normal N, ignoring shadows
+        void lightTerms(Light const &light, Material const &material,
+                        Color const &matColor, Point const &hit,
+                        Vector const &N, Vector const &V,
+                        Color &diffuseTerm, Color &specularTerm) const;
+
+        // refracted direction T of direction D at a transparent surface with
+        // normal N, and the fractions kr and kt of reflected and refracted light
+        void refraction(Vector const &D, Vector const &N,
+                        Material const &material, bool inside,
+                        Vector &T, Scalar &kr, Scalar &kt) const;
+
+        // color of the camera ray through (x, y), towards samples spacing
+        // pixels away
+        Color sample(Scalar x, Scalar y, bool inside, Scalar spacing);
 
-        unsigned getNumObject();
-        unsigned getNumLights();
+        friend class Progressive;
+        friend class Wavefront;
 };
 
 #endif
@@ -0,0 +1,288 @@
+#include "mesh.h"
+
+#include "../objloader.h"
+#include "../statistics.h"
+#include "../vertex.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    Scalar const NO_HIT = numeric_limits<Scalar>::quiet_NaN();
+
+    // rotate v by r.x, r.y and r.z radians around the x, y and z axes
+    Vector rotate(Vector const &v, Vector const &r)
+    {
+        Vector x(v.x,
+                 v.y * cos(r.x) - v.z * sin(r.x),
+                 v.y * sin(r.x) + v.z * cos(r.x));
+        Vector y(x.x * cos(r.y) + x.z * sin(r.y),
+                 x.y,
+                 -x.x * sin(r.y) + x.z * cos(r.y));
+        return Vector(y.x * cos(r.z) - y.y * sin(r.z),
+                      y.x * sin(r.z) + y.y * cos(r.z),
+                      y.z);
+    }
+}
+
+Hit Mesh::intersect(Ray const &ray)
+{
+    // Equally close hits (on shared edges) resolve to the lowest triangle
+    // index, so the result does not depend on the traversal order.
+    Scalar tMax = numeric_limits<Scalar>::infinity();
+    unsigned best = numTriangles();
+    Scalar bestB1 = 0;
+    Scalar bestB2 = 0;
+
+    unsigned tests = 0;
+    unsigned boxTests = d_bvh.traverse(ray, tMax, [&](unsigned tri, Scalar &tMax)
+    {
+        STAT_COUNT(tests);
+        Scalar b1;
+        Scalar b2;
+        Scalar t = intersectTriangle(tri, ray, b1, b2);
+        if (t < tMax || (t == tMax && tri < best))
+        {
+            tMax = t;
+            best = tri;
+            bestB1 = b1;
+            bestB2 = b2;
+        }
+        return false;
+    });
+
+    STAT_ADD(boxTests, boxTests);
+    STAT_ADD(primitiveTests, tests);
+
+    if (best == numTriangles())
+        return Hit::NO_HIT();
+
+    uint32_t const *tri = &d_indices[3 * best];
+    Vector N = (1 - bestB1 - bestB2) * d_normals[tri[0]]
+               + bestB1 * d_normals[tri[1]] + bestB2 * d_normals[tri[2]];
+
+    // vertices without a usable normal: use the normal of the triangle
+    if (!(N.length_2() > 0))
+        N = (d_positions[tri[1]] - d_positions[tri[0]])
+                .cross(d_positions[tri[2]] - d_positions[tri[0]]);
+
+    return Hit(tMax, N.normalized(), best);
+}
+
+bool Mesh::intersectAny(Ray const &ray, Scalar maxT)
+{
+    bool hit = false;
+    unsigned tests = 0;
+    unsigned boxTests = d_bvh.traverse(ray, maxT, [&](unsigned tri, Scalar &maxT)
+    {
+        STAT_COUNT(tests);
+        Scalar b1;
+        Scalar b2;
+        hit = intersectTriangle(tri, ray, b1, b2) < maxT;
+        return hit;
+    });
+
+    STAT_ADD(boxTests, boxTests);
+    STAT_ADD(primitiveTests, tests);
+    return hit;
+}
+
+Vector Mesh::toUV(Point const &hit, unsigned part)
+{
+    if (d_texCoords.empty())
+        return Vector();
+
+    // Points next to the triangle (for ray differentials) are extrapolated
+    // linearly from it.
+    Scalar b1;
+    Scalar b2;
+    barycentric(part, hit, b1, b2);
+    Scalar b0 = 1 - b1 - b2;
+
+    uint32_t const *tri = &d_indices[3 * part];
+    TexCoord const &uv0 = d_texCoords[tri[0]];
+    TexCoord const &uv1 = d_texCoords[tri[1]];
+    TexCoord const &uv2 = d_texCoords[tri[2]];
+    return Vector(b0 * uv0.u + b1 * uv1.u + b2 * uv2.u,
+                  b0 * uv0.v + b1 * uv1.v + b2 * uv2.v,
+                  0.0);
+}
+
+AABB Mesh::boundingBox() const
+{
+    return d_box;
+}
+
+double Mesh::buildTime() const
+{
+    return d_buildTime;
+}
+
+unsigned Mesh::numTriangles() const
+{
+    return d_indices.size() / 3;
+}
+
+unsigned Mesh::numVertices() const
+{
+    return d_positions.size();
+}
+
+Mesh::Mesh(string const &filename, Point const &position,
+           Vector const &rotation, Vector const &scale, bool movable)
+:
+    d_buildTime(0)
+{
+    OBJLoader model(filename);
+    vector<Vertex> const &vertices = model.vertices();
+
+    vector<Point> positions;
+    vector<Vector> normals;
+    positions.reserve(vertices.size());
+    normals.reserve(vertices.size());
+    if (model.hasTexCoords())
+        d_texCoords.reserve(vertices.size());
+
+    for (Vertex const &vertex : vertices)
+    {
+        positions.push_back(Point(vertex.x, vertex.y, vertex.z));
+        normals.push_back(Vector(vertex.nx, vertex.ny, vertex.nz));
+        if (model.hasTexCoords())
+            d_texCoords.push_back(TexCoord{vertex.u, vertex.v});
+    }
+
+    transform(positions, normals, position, rotation, scale);
+    if (movable)
+    {
+        d_modelPositions.swap(positions);
+        d_modelNormals.swap(normals);
+    }
+
+    d_indices.assign(model.indices().begin(), model.indices().end());
+    auto start = chrono::steady_clock::now();
+    d_bvh.build(triangleBoxes());
+    d_buildTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Loaded model: " << filename << " with " << numTriangles()
+         << " triangles and " << numVertices() << " vertices (BVH: "
+         << d_bvh.numNodes() << " nodes, built in " << d_buildTime * 1E3
+         << " ms).\n";
+}
+
+void Mesh::setTransform(Point const &position, Vector const &rotation,
+                        Vector const &scale)
+{
+    if (d_modelPositions.size() != d_positions.size())
+        throw logic_error("Mesh::setTransform called on a mesh which is not "
+                          "movable.");
+
+    transform(d_modelPositions, d_modelNormals, position, rotation, scale);
+}
+
+bool Mesh::updateBVH(Scalar maxGrowth)
+{
+    return d_bvh.update(triangleBoxes(), maxGrowth);
+}
+
+// --- Private -----------------------------------------------------------------
+
+void Mesh::transform(vector<Point> const &positions,
+                     vector<Vector> const &normals, Point const &position,
+                     Vector const &rotation, Vector const &scale)
+{
+    d_positions.clear();
+    d_normals.clear();
+    d_positions.reserve(positions.size());
+    d_normals.reserve(normals.size());
+    d_box = AABB();
+
+    // Scale, rotate and translate the vertices. Normals are scaled by the
+    // inverse scale, which keeps them perpendicular to the surface.
+    for (unsigned idx = 0; idx != positions.size(); ++idx)
+    {
+        Point p = rotate(positions[idx] * scale, rotation) + position;
+        d_positions.push_back(p);
+        d_box.extend(p);
+
+        Vector const &n = normals[idx];
+        Vector N(n.x / scale.x, n.y / scale.y, n.z / scale.z);
+        N = rotate(N, rotation);
+        if (N.length_2() > 0)
+            N.normalize();
+        d_normals.push_back(N);
+    }
+}
+
+vector<AABB> Mesh::triangleBoxes() const
+{
+    vector<AABB> boxes;
+    boxes.reserve(numTriangles());
+    for (unsigned tri = 0; tri != numTriangles(); ++tri)
+    {
+        AABB box;
+        for (unsigned corner = 0; corner != 3; ++corner)
+            box.extend(d_positions[d_indices[3 * tri + corner]]);
+        boxes.push_back(box);
+    }
+    return boxes;
+}
+
+Scalar Mesh::intersectTriangle(unsigned tri, Ray const &ray,
+                               Scalar &b1, Scalar &b2) const
+{
+    // Moeller-Trumbore: solve O + t D = v0 + b1 (v1 - v0) + b2 (v2 - v0)
+    uint32_t const *idx = &d_indices[3 * tri];
+    Point const &v0 = d_positions[idx[0]];
+    Vector edge1 = d_positions[idx[1]] - v0;
+    Vector edge2 = d_positions[idx[2]] - v0;
+
+    Vector P = ray.D.cross(edge2);
+    Scalar det = edge1.dot(P);
+    if (det == 0.0)
+        return NO_HIT;      // parallel to the triangle
+
+    Scalar invDet = 1.0 / det;
+    Vector T = ray.O - v0;
+    b1 = T.dot(P) * invDet;
+    if (b1 < 0.0 || b1 > 1.0)
+        return NO_HIT;
+
+    Vector Q = T.cross(edge1);
+    b2 = ray.D.dot(Q) * invDet;
+    if (b2 < 0.0 || b1 + b2 > 1.0)
+        return NO_HIT;
+
+    Scalar t = edge2.dot(Q) * invDet;
+    return t < 0.0 ? NO_HIT : t;
+}
+
+void Mesh::barycentric(unsigned tri, Point const &point,
+                       Scalar &b1, Scalar &b2) const
+{
+    uint32_t const *idx = &d_indices[3 * tri];
+    Point const &v0 = d_positions[idx[0]];
+    Vector edge1 = d_positions[idx[1]] - v0;
+    Vector edge2 = d_positions[idx[2]] - v0;
+    Vector P = point - v0;
+
+    Scalar d11 = edge1.dot(edge1);
+    Scalar d12 = edge1.dot(edge2);
+    Scalar d22 = edge2.dot(edge2);
+    Scalar p1 = P.dot(edge1);
+    Scalar p2 = P.dot(edge2);
+    Scalar denom = d11 * d22 - d12 * d12;
+    if (denom == 0.0)
+    {
+        b1 = b2 = 0.0;      // degenerate triangle
+        return;
+    }
+
+    b1 = (d22 * p1 - d12 * p2) / denom;
+    b2 = (d11 * p2 - d12 * p1) / denom;
+}
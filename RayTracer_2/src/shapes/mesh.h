@@ -0,0 +1,98 @@
+#ifndef MESH_H_
+#define MESH_H_
+
+#include "../bvh.h"
+#include "../object.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Triangle mesh loaded from an .obj file. Vertices are shared by the
+// triangles using them: positions, normals and texture coordinates are
+// stored once per vertex, a triangle is just three 32-bit vertex indices.
+// Normals and texture coordinates at a hit are interpolated from those of
+// the vertices of the triangle with the barycentric coordinates of the hit,
+// so meshes are smooth shaded.
+//
+// The triangles are intersected through a BVH of their own. Hit::part is
+// the index of the triangle hit, which toUV uses to interpolate.
+class Mesh: public Object
+{
+    struct TexCoord
+    {
+        Scalar u;
+        Scalar v;
+    };
+
+    std::vector<Point> d_positions;
+    std::vector<Vector> d_normals;
+    std::vector<TexCoord> d_texCoords;      // empty if the file has none
+    std::vector<std::uint32_t> d_indices;   // three per triangle
+
+    // vertices as loaded, only kept for setTransform by movable meshes
+    std::vector<Point> d_modelPositions;
+    std::vector<Vector> d_modelNormals;
+
+    BVH d_bvh;
+    AABB d_box;
+
+    double d_buildTime;     // seconds spent building the BVH in the constructor
+
+    public:
+        // The model is scaled per axis, rotated by rotation.x, .y and .z
+        // radians around the x, y and z axes (in that order) and then
+        // moved to position. Throws runtime_error if the file cannot be
+        // loaded. A movable mesh keeps the vertices as loaded (which takes
+        // twice the memory), so it can be moved by setTransform.
+        Mesh(std::string const &filename,
+             Point const &position = Point(),
+             Vector const &rotation = Vector(),
+             Vector const &scale = Vector(1, 1, 1),
+             bool movable = false);
+
+        // Transform the mesh as loaded anew (see the constructor). Throws
+        // logic_error if the mesh is not movable. Call updateBVH before
+        // intersecting the mesh again.
+        void setTransform(Point const &position, Vector const &rotation,
+                          Vector const &scale);
+
+        // Refit the BVH to the moved triangles, or rebuild it if refitting
+        // makes it too slow (see BVH::update). Returns whether it was
+        // rebuilt.
+        bool updateBVH(Scalar maxGrowth);
+
+        Hit intersect(Ray const &ray) override;
+        bool intersectAny(Ray const &ray, Scalar maxT) override;
+        using Object::toUV;
+        Vector toUV(Point const &hit, unsigned part) override;
+        AABB boundingBox() const override;
+
+        double buildTime() const;
+
+        unsigned numTriangles() const;
+        unsigned numVertices() const;
+
+    private:
+        // set the positions and normals to the model vertices transformed
+        void transform(std::vector<Point> const &positions,
+                       std::vector<Vector> const &normals,
+                       Point const &position, Vector const &rotation,
+                       Vector const &scale);
+
+        // bounding boxes of the triangles
+        std::vector<AABB> triangleBoxes() const;
+
+        // Distance to triangle tri along the ray, NaN if it is missed. b1
+        // and b2 receive the barycentric coordinates of the hit (the
+        // weights of the second and third vertex).
+        Scalar intersectTriangle(unsigned tri, Ray const &ray,
+                                 Scalar &b1, Scalar &b2) const;
+
+        // barycentric coordinates of point, projected on the plane of
+        // triangle tri
+        void barycentric(unsigned tri, Point const &point,
+                         Scalar &b1, Scalar &b2) const;
+};
+
+#endif
@@ -10,12 +10,12 @@
 Hit Quad::intersect(Ray const &ray)
 {
     // Catch the case where the ray is parallel to the plane, i.e. no intersection.
-    double DdotN = (-ray.D).dot(N);
-    if (std::abs(DdotN) < std::numeric_limits<double>::epsilon())
+    Scalar DdotN = (-ray.D).dot(N);
+    if (std::abs(DdotN) < std::numeric_limits<Scalar>::epsilon())
         return Hit::NO_HIT();
 
     // Find the point of intersection with the plane.
-    double t = -N.dot(ray.O - v0) / N.dot(ray.D);
+    Scalar t = -N.dot(ray.O - v0) / N.dot(ray.D);
 
     if (t < 0.0)
         return Hit::NO_HIT();
@@ -23,8 +23,8 @@ Hit Quad::intersect(Ray const &ray)
     Point hit = ray.at(t);
 
     // Determine if the hit is inside of the quad.
-    double u = (hit - v0).dot(v1 - v0);
-    double v = (hit - v0).dot(v3 - v0);
+    Scalar u = (hit - v0).dot(v1 - v0);
+    Scalar v = (hit - v0).dot(v3 - v0);
     if (0.0 <= u and u <= (v1 - v0).length_2() and
         0.0 <= v and v <= (v3 - v0).length_2())
         return Hit(t, N);
@@ -32,14 +32,41 @@ Hit Quad::intersect(Ray const &ray)
     return Hit::NO_HIT();
 }
 
+bool Quad::intersectAny(Ray const &ray, Scalar maxT)
+{
+    Scalar DdotN = (-ray.D).dot(N);
+    if (std::abs(DdotN) < std::numeric_limits<Scalar>::epsilon())
+        return false;
+
+    Scalar t = -N.dot(ray.O - v0) / N.dot(ray.D);
+    if (t < 0.0 || t >= maxT)
+        return false;
+
+    Point hit = ray.at(t);
+    Scalar u = (hit - v0).dot(v1 - v0);
+    Scalar v = (hit - v0).dot(v3 - v0);
+    return 0.0 <= u and u <= (v1 - v0).length_2() and
+           0.0 <= v and v <= (v3 - v0).length_2();
+}
+
 Vector Quad::toUV(Point const &hit)
 {
-    double u = (hit - v0).dot(v1 - v0) / (v1 - v0).length_2();
-    double v = (hit - v0).dot(v3 - v0) / (v3 - v0).length_2();
+    Scalar u = (hit - v0).dot(v1 - v0) / (v1 - v0).length_2();
+    Scalar v = (hit - v0).dot(v3 - v0) / (v3 - v0).length_2();
 
     return Vector(u, v, 0.0);
 }
 
+AABB Quad::boundingBox() const
+{
+    AABB box;
+    box.extend(v0);
+    box.extend(v1);
+    box.extend(v2);
+    box.extend(v3);
+    return box;
+}
+
 Quad::Quad(Point const &v0,
            Point const &v1,
            Point const &v2,
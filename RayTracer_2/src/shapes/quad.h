@@ -12,7 +12,9 @@ class Quad: public Object
              Point const &v3);
 
         Hit intersect(Ray const &ray) override;
+        bool intersectAny(Ray const &ray, Scalar maxT) override;
         Vector toUV(Point const &hit) override;
+        AABB boundingBox() const override;
 
         Point const v0;
         Point const v1;
@@ -1,6 +1,8 @@
 #ifndef SOLVERS_H_
 #define SOLVERS_H_
 
+#include "../scalar.h"
+
 class Solvers
 {
     public:
@@ -8,8 +10,8 @@ class Solvers
         // return false if no solution
         // x0 <= x1
         // uses pass by reference (hence the &)
-        static bool quadratic(double a, double b, double c,
-                              double &x0, double &x1);
+        static bool quadratic(Scalar a, Scalar b, Scalar c,
+                              Scalar &x0, Scalar &x1);
 };
 
 #endif
@@ -1,6 +1,7 @@
 #include "sphere.h"
 #include "solvers.h"
 
+#include <algorithm>
 #include <cmath>
 
 using namespace std;
@@ -11,12 +12,12 @@ Hit Sphere::intersect(Ray const &ray)
     // Line formula:   x = ray.O + t * ray.D
 
     Vector L = ray.O - position;
-    double a = ray.D.dot(ray.D);
-    double b = 2.0 * ray.D.dot(L);
-    double c = L.dot(L) - r * r;
+    Scalar a = ray.D.dot(ray.D);
+    Scalar b = 2.0 * ray.D.dot(L);
+    Scalar c = L.dot(L) - r * r;
 
-    double t0;
-    double t1;
+    Scalar t0;
+    Scalar t1;
     if (not Solvers::quadratic(a, b, c, t0, t1))
         return Hit::NO_HIT();
 
@@ -38,6 +39,23 @@ Hit Sphere::intersect(Ray const &ray)
     return Hit(t0, N);
 }
 
+bool Sphere::intersectAny(Ray const &ray, Scalar maxT)
+{
+    // As intersect, without computing the normal
+    Vector L = ray.O - position;
+    Scalar a = ray.D.dot(ray.D);
+    Scalar b = 2.0 * ray.D.dot(L);
+    Scalar c = L.dot(L) - r * r;
+
+    Scalar t0;
+    Scalar t1;
+    if (not Solvers::quadratic(a, b, c, t0, t1))
+        return false;
+
+    Scalar t = t0 < 0.0 ? t1 : t0;
+    return t >= 0.0 && t < maxT;
+}
+
 Vector Sphere::rotate(Vector v, Vector r) {
     Vector newVec = v;
 	// Rotation around x axis
@@ -64,14 +82,20 @@ Vector Sphere::toUV(Point const &hit)
 	
 	newHit = rotate(newHit, (-(PI*angle)/180)*axis);
 
-    double u = 0.5 + atan2(newHit.y, newHit.x)/(2*PI);
-    double v = 1 - acos(newHit.z/r)/PI;
+    Scalar u = 0.5 + atan2(newHit.y, newHit.x)/(2*PI);
+    // (clamped, points next to the sphere are passed for ray differentials)
+    Scalar v = 1 - acos(max(Scalar(-1), min(newHit.z/r, Scalar(1))))/PI;
 
     // Use a Vector to return 2 doubles. The third value is never read.
     return Vector{u, v, 0.0};
 }
 
-Sphere::Sphere(Point const &pos, double radius, Vector const& axis, double angle)
+AABB Sphere::boundingBox() const
+{
+    return AABB(position - r, position + r);
+}
+
+Sphere::Sphere(Point const &pos, Scalar radius, Vector const& axis, Scalar angle)
 :
     // Feel free to modify this constructor.
     position(pos),
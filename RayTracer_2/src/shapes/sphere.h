@@ -5,20 +5,22 @@
 
 class Sphere: public Object
 {
-    double const PI = 3.14159265358979323846;
+    Scalar const PI = 3.14159265358979323846;
 
     public:
-        Sphere(Point const &pos, double radius,
-               Vector const& axis = Vector(0.0, 1.0, 0.0), double angle = 0.0);
+        Sphere(Point const &pos, Scalar radius,
+               Vector const& axis = Vector(0.0, 1.0, 0.0), Scalar angle = 0.0);
 
         Hit intersect(Ray const &ray) override;
+        bool intersectAny(Ray const &ray, Scalar maxT) override;
         Vector toUV(Point const &hit) override;
+        AABB boundingBox() const override;
 	Vector rotate(Vector v, Vector r); 
 
         Point const position;
-        double const r;
+        Scalar const r;
         Vector const axis;
-        double const angle;
+        Scalar const angle;
 };
 
 #endif
@@ -0,0 +1,91 @@
+#ifndef STATISTICS_H_
+#define STATISTICS_H_
+
+#include <algorithm>
+
+// Counts of the work done while rendering: the rays traced by kind, the
+// intersection tests and the texture lookups. Every thread counts in its
+// own instance (local()), so counting needs no synchronization;
+// Scene::render adds the counts of the threads up after every tile.
+//
+// Counting is done with the STAT_ADD and STAT_MAX macros, which compile to
+// nothing unless RAY_STATISTICS is defined (the RAY_STATISTICS option of
+// the CMake build, on by default). Their arguments should have no side
+// effects. STAT_COUNT likewise increments a local counter that is later
+// passed to STAT_ADD, so loops on the hot path do not count for nothing.
+class Statistics
+{
+    public:
+#ifdef RAY_STATISTICS
+        static bool const ENABLED = true;
+#else
+        static bool const ENABLED = false;
+#endif
+
+        unsigned long primary = 0;          // camera rays
+        unsigned long shadow = 0;           // rays towards the lights
+        unsigned long reflected = 0;
+        unsigned long refracted = 0;
+
+        unsigned long boxTests = 0;         // BVH node bounding boxes
+        unsigned long primitiveTests = 0;   // objects
+
+        unsigned long textureLookups = 0;
+
+        // Recursion level of the camera, reflected and refracted rays:
+        // camera rays are at level 0, the rays they spawn at level 1, etc.
+        unsigned long levelSum = 0;
+        unsigned long maxLevel = 0;
+
+        unsigned long secondary() const
+        {
+            return reflected + refracted;
+        }
+
+        unsigned long total() const
+        {
+            return primary + shadow + secondary();
+        }
+
+        // average recursion level of the camera, reflected and refracted rays
+        double averageLevel() const
+        {
+            unsigned long rays = primary + secondary();
+            return rays == 0 ? 0 : static_cast<double>(levelSum) / rays;
+        }
+
+        Statistics &operator+=(Statistics const &other)
+        {
+            primary += other.primary;
+            shadow += other.shadow;
+            reflected += other.reflected;
+            refracted += other.refracted;
+            boxTests += other.boxTests;
+            primitiveTests += other.primitiveTests;
+            textureLookups += other.textureLookups;
+            levelSum += other.levelSum;
+            maxLevel = std::max(maxLevel, other.maxLevel);
+            return *this;
+        }
+
+        // the counts of the calling thread
+        static Statistics &local()
+        {
+            static thread_local Statistics stats;
+            return stats;
+        }
+};
+
+#ifdef RAY_STATISTICS
+#define STAT_ADD(counter, count) (Statistics::local().counter += (count))
+#define STAT_COUNT(count) (++(count))
+#define STAT_MAX(counter, value) \
+    (Statistics::local().counter = std::max(Statistics::local().counter, \
+                                            static_cast<unsigned long>(value)))
+#else
+#define STAT_ADD(counter, count) static_cast<void>(count)
+#define STAT_COUNT(count) static_cast<void>(count)
+#define STAT_MAX(counter, value) static_cast<void>(value)
+#endif
+
+#endif
@@ -0,0 +1,173 @@
+#include "texture.h"
+
+#include "lode/lodepng.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    // maximum number of samples along a stretched footprint
+    unsigned const MAX_ANISOTROPY = 8;
+}
+
+Texture::Texture(string const &filename)
+:
+    d_levels(1)
+{
+    Level &image = d_levels[0];
+    unsigned error = lodepng::decode(image.texels, image.width, image.height,
+                                     filename);
+    if (error || image.width == 0 || image.height == 0)
+        throw runtime_error("Texture(): could not read " + filename + ": "
+                            + lodepng_error_text(error));
+
+    buildMipLevels();
+}
+
+unsigned Texture::width() const
+{
+    return d_levels[0].width;
+}
+
+unsigned Texture::height() const
+{
+    return d_levels[0].height;
+}
+
+unsigned Texture::numLevels() const
+{
+    return d_levels.size();
+}
+
+Color Texture::colorAt(float x, float y) const
+{
+    Level const &image = d_levels[0];
+    unsigned col = min(static_cast<unsigned>(x * (image.width - 1)), image.width - 1);
+    unsigned row = min(static_cast<unsigned>(y * (image.height - 1)), image.height - 1);
+    return texel(image, col, row);
+}
+
+Color Texture::sample(float x, float y, Vector const &dx, Vector const &dy,
+                      Filter filter) const
+{
+    switch (filter)
+    {
+        case NEAREST:
+            return colorAt(x, y);
+        case BILINEAR:
+            return bilinear(d_levels[0], x, y);
+        default:
+            break;
+    }
+
+    // Footprint axes in texels. Filtering isotropically over the longer
+    // axis would blur far too much where the footprint is stretched (as
+    // near the poles of a sphere), so up to MAX_ANISOTROPY trilinear
+    // samples are taken along it, each covering the shorter axis.
+    Level const &image = d_levels[0];
+    float lengthX = hypot(dx.x * image.width, dx.y * image.height);
+    float lengthY = hypot(dy.x * image.width, dy.y * image.height);
+    Vector major = lengthX > lengthY ? dx : dy;
+    float majorLength = max(lengthX, lengthY);
+    float minorLength = min(lengthX, lengthY);
+
+    unsigned taps = 1;
+    if (majorLength > minorLength)
+        taps = min(static_cast<unsigned>(ceil(majorLength / max(minorLength, 1.0f))),
+                   MAX_ANISOTROPY);
+
+    float texels = majorLength / taps;
+    float lod = texels > 1.0f ? log2(texels) : 0.0f;
+    if (taps == 1)
+        return trilinear(x, y, lod);
+
+    Color color;
+    for (unsigned tap = 0; tap != taps; ++tap)
+    {
+        float offset = (tap + 0.5f) / taps - 0.5f;
+        float tx = x + offset * major.x;
+        tx -= floor(tx);                    // wrap around horizontally
+        color += trilinear(tx, y + offset * major.y, lod);
+    }
+    return color / taps;
+}
+
+// --- Private -----------------------------------------------------------------
+
+void Texture::buildMipLevels()
+{
+    // Box filter 2 x 2 blocks of texels (clamped at odd edges)
+    while (d_levels.back().width > 1 || d_levels.back().height > 1)
+    {
+        Level const &prev = d_levels.back();
+        Level next;
+        next.width = max(prev.width / 2, 1U);
+        next.height = max(prev.height / 2, 1U);
+        next.texels.resize(4 * next.width * next.height);
+
+        for (unsigned y = 0; y != next.height; ++y)
+            for (unsigned x = 0; x != next.width; ++x)
+            {
+                unsigned x0 = min(2 * x, prev.width - 1);
+                unsigned x1 = min(2 * x + 1, prev.width - 1);
+                unsigned y0 = min(2 * y, prev.height - 1);
+                unsigned y1 = min(2 * y + 1, prev.height - 1);
+                for (unsigned channel = 0; channel != 4; ++channel)
+                {
+                    unsigned sum = prev.texels[4 * (y0 * prev.width + x0) + channel]
+                                 + prev.texels[4 * (y0 * prev.width + x1) + channel]
+                                 + prev.texels[4 * (y1 * prev.width + x0) + channel]
+                                 + prev.texels[4 * (y1 * prev.width + x1) + channel];
+                    next.texels[4 * (y * next.width + x) + channel] = (sum + 2) / 4;
+                }
+            }
+
+        d_levels.push_back(move(next));
+    }
+}
+
+Color Texture::trilinear(float x, float y, float lod) const
+{
+    lod = min(lod, static_cast<float>(d_levels.size() - 1));
+
+    unsigned fine = static_cast<unsigned>(lod);
+    unsigned coarse = min<unsigned>(fine + 1, d_levels.size() - 1);
+    float weight = lod - fine;
+
+    Color color = bilinear(d_levels[fine], x, y);
+    if (weight > 0.0f)
+        color = (1.0f - weight) * color + weight * bilinear(d_levels[coarse], x, y);
+    return color;
+}
+
+Color Texture::texel(Level const &level, unsigned x, unsigned y) const
+{
+    unsigned char const *rgba = &level.texels[4 * (y * level.width + x)];
+
+    // Alpha is ignored
+    return Color(rgba[0] / 255.0, rgba[1] / 255.0, rgba[2] / 255.0);
+}
+
+Color Texture::bilinear(Level const &level, float x, float y) const
+{
+    // colorAt maps texel i to [i, i + 1) / (size - 1), so its center is
+    // half a texel further (written so that NaN coordinates give texel 0)
+    float fx = (x > 0.0f ? min(x, 1.0f) : 0.0f) * (level.width - 1) - 0.5f;
+    float fy = (y > 0.0f ? min(y, 1.0f) : 0.0f) * (level.height - 1) - 0.5f;
+    fx = min(max(fx, 0.0f), level.width - 1.0f);
+    fy = min(max(fy, 0.0f), level.height - 1.0f);
+    unsigned x0 = static_cast<unsigned>(fx);
+    unsigned y0 = static_cast<unsigned>(fy);
+    unsigned x1 = min(x0 + 1, level.width - 1);
+    unsigned y1 = min(y0 + 1, level.height - 1);
+    float ax = fx - x0;
+    float ay = fy - y0;
+
+    Color top = (1.0f - ax) * texel(level, x0, y0) + ax * texel(level, x1, y0);
+    Color bottom = (1.0f - ax) * texel(level, x0, y1) + ax * texel(level, x1, y1);
+    return (1.0f - ay) * top + ay * bottom;
+}
@@ -0,0 +1,68 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include "triple.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Texture image, read from a PNG file. The texels are stored as they are in
+// the file, in 8-bit RGBA, and only converted to Colors on lookup: a sixth of
+// the memory an Image of the same size needs (a third in single precision).
+//
+// On loading, a mip pyramid is built: each level halves the resolution of
+// the previous one, down to a single texel. Filtered lookups use it to
+// average over the footprint of a pixel without aliasing.
+class Texture
+{
+    public:
+        enum Filter
+        {
+            NEAREST,        // nearest texel of the full resolution image
+            BILINEAR,       // bilinear interpolation of the full image
+            TRILINEAR       // bilinear in the two mip levels closest to the
+                            // footprint, interpolated between them (several
+                            // samples for stretched footprints)
+        };
+
+    private:
+        struct Level
+        {
+            unsigned width;
+            unsigned height;
+            std::vector<unsigned char> texels;  // RGBA, row major
+        };
+
+        std::vector<Level> d_levels;    // d_levels[0] is the full image
+
+    public:
+        explicit Texture(std::string const &filename);
+
+        unsigned width() const;
+        unsigned height() const;
+        unsigned numLevels() const;
+
+        // Color of the texel nearest to normalized coordinates (0...1, 0...1)
+        Color colorAt(float x, float y) const;
+
+        // Color at normalized coordinates, filtered over the footprint of a
+        // pixel. dx and dy hold the change of the coordinates towards the
+        // neighbouring pixels (as x and y of the Vectors).
+        Color sample(float x, float y, Vector const &dx, Vector const &dy,
+                     Filter filter) const;
+
+    private:
+        void buildMipLevels();
+
+        // bilinear samples of the mip levels around lod, interpolated
+        Color trilinear(float x, float y, float lod) const;
+
+        Color texel(Level const &level, unsigned x, unsigned y) const;
+        Color bilinear(Level const &level, float x, float y) const;
+};
+
+// Textures are immutable once loaded, so materials can share them.
+typedef std::shared_ptr<Texture const> TexturePtr;
+
+#endif
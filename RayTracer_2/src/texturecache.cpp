@@ -0,0 +1,19 @@
+#include "texturecache.h"
+
+using namespace std;
+
+TexturePtr TextureCache::load(string const &filename)
+{
+    auto found = d_textures.find(filename);
+    if (found != d_textures.end())
+        return found->second;
+
+    TexturePtr texture = make_shared<Texture const>(filename);
+    d_textures[filename] = texture;
+    return texture;
+}
+
+unsigned TextureCache::size() const
+{
+    return d_textures.size();
+}
@@ -0,0 +1,23 @@
+#ifndef TEXTURECACHE_H_
+#define TEXTURECACHE_H_
+
+#include "texture.h"
+
+#include <map>
+#include <string>
+
+// Textures by file name. Every file is read once; all materials using it
+// share the same Texture.
+class TextureCache
+{
+    std::map<std::string, TexturePtr> d_textures;
+
+    public:
+        // the texture in filename, read on first use
+        TexturePtr load(std::string const &filename);
+
+        // number of distinct textures loaded
+        unsigned size() const;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "tilescheduler.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+using namespace std;
+
+TileScheduler::TileScheduler(unsigned width, unsigned height,
+                             unsigned tileSize, unsigned numThreads)
+:
+    d_numThreads(numThreads)
+{
+    if (d_numThreads == 0)
+        d_numThreads = max(thread::hardware_concurrency(), 1U);
+
+    tileSize = max(tileSize, 1U);
+    for (unsigned y = 0; y < height; y += tileSize)
+        for (unsigned x = 0; x < width; x += tileSize)
+            d_tiles.push_back(Tile{x, y, min(x + tileSize, width),
+                                   min(y + tileSize, height)});
+
+    // no use for threads without work
+    d_numThreads = max(min<unsigned>(d_numThreads, d_tiles.size()), 1U);
+}
+
+void TileScheduler::run(function<void(Tile const &)> const &renderTile) const
+{
+    if (d_numThreads == 1)
+    {
+        for (Tile const &tile : d_tiles)
+            renderTile(tile);
+        return;
+    }
+
+    // Deal out contiguous blocks of tiles: every thread starts on its own
+    // part of the image, and threads which run out steal from the others.
+    unique_ptr<Queue[]> queues(new Queue[d_numThreads]);
+    for (unsigned idx = 0; idx != d_tiles.size(); ++idx)
+        queues[idx * d_numThreads / d_tiles.size()].tiles.push_back(d_tiles[idx]);
+
+    auto worker = [&](unsigned self)
+    {
+        Tile tile;
+        while (true)
+        {
+            if (pop(queues[self], tile))
+            {
+                renderTile(tile);
+                continue;
+            }
+
+            // Own queue is empty: steal from the others, starting with the
+            // next thread. Tiles are never added, so when every queue is
+            // found empty all work has been handed out.
+            bool stolen = false;
+            for (unsigned offset = 1; offset != d_numThreads && !stolen; ++offset)
+                stolen = steal(queues[(self + offset) % d_numThreads], tile);
+
+            if (!stolen)
+                return;
+            renderTile(tile);
+        }
+    };
+
+    vector<thread> threads;
+    for (unsigned idx = 1; idx != d_numThreads; ++idx)
+        threads.emplace_back(worker, idx);
+    worker(0);      // the calling thread also participates
+
+    for (thread &thr : threads)
+        thr.join();
+}
+
+unsigned TileScheduler::numThreads() const
+{
+    return d_numThreads;
+}
+
+unsigned TileScheduler::numTiles() const
+{
+    return d_tiles.size();
+}
+
+bool TileScheduler::pop(Queue &queue, Tile &tile)
+{
+    lock_guard<mutex> guard(queue.lock);
+    if (queue.tiles.empty())
+        return false;
+    tile = queue.tiles.front();
+    queue.tiles.pop_front();
+    return true;
+}
+
+bool TileScheduler::steal(Queue &queue, Tile &tile)
+{
+    lock_guard<mutex> guard(queue.lock);
+    if (queue.tiles.empty())
+        return false;
+    tile = queue.tiles.back();
+    queue.tiles.pop_back();
+    return true;
+}
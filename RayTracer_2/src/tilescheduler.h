@@ -0,0 +1,51 @@
+#ifndef TILESCHEDULER_H_
+#define TILESCHEDULER_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Splits an image into square tiles and renders them on a pool of threads.
+// Every thread owns a queue of tiles, initially a contiguous block of rows
+// of tiles. A thread takes tiles from the front of its own queue and, once
+// that is empty, steals from the back of the queue of another thread.
+class TileScheduler
+{
+    public:
+        struct Tile
+        {
+            unsigned x0;    // first column
+            unsigned y0;    // first row
+            unsigned x1;    // one past the last column
+            unsigned y1;    // one past the last row
+        };
+
+    private:
+        struct Queue
+        {
+            std::mutex lock;
+            std::deque<Tile> tiles;
+        };
+
+        std::vector<Tile> d_tiles;
+        unsigned d_numThreads;
+
+    public:
+        // numThreads == 0 uses all hardware threads
+        TileScheduler(unsigned width, unsigned height,
+                      unsigned tileSize, unsigned numThreads);
+
+        // Call renderTile once for every tile. Returns when all tiles are
+        // done. renderTile is called concurrently for different tiles.
+        void run(std::function<void(Tile const &)> const &renderTile) const;
+
+        unsigned numThreads() const;
+        unsigned numTiles() const;
+
+    private:
+        static bool pop(Queue &queue, Tile &tile);
+        static bool steal(Queue &queue, Tile &tile);
+};
+
+#endif
@@ -2,9 +2,36 @@
 #define TRIPLE_H_
 
 #include "json/json_fwd.h"
+#include "scalar.h"
 
+#include <cmath>
 #include <iosfwd>
 
+// All arithmetic on Triples is defined inline in this header, so it can be
+// inlined in the hot paths of the ray tracer (only the json constructor and
+// the IO operators live in triple.cpp). Without SIMD backing (the default),
+// the constructors and operators are constexpr.
+//
+// When TRIPLE_SIMD is defined (cmake -DTRIPLE_SIMD=ON), Triples are stored in
+// SSE2 (x86) or NEON (AArch64) registers, padded with a fourth element: two
+// registers of two doubles, or a single register of four floats. Memberwise
+// operations then use vector instructions. They compute exactly the same
+// values as the scalar code.
+#if defined(TRIPLE_SIMD) && defined(__SSE2__)
+    #define TRIPLE_SSE2
+    #include <emmintrin.h>
+#elif defined(TRIPLE_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+    #define TRIPLE_NEON
+    #include <arm_neon.h>
+#endif
+
+#if defined(TRIPLE_SSE2) || defined(TRIPLE_NEON)
+    #define TRIPLE_VECTORIZED
+    #define TRIPLE_CONSTEXPR inline
+#else
+    #define TRIPLE_CONSTEXPR constexpr
+#endif
+
 // Color, Point and Vector are all Triples (name them so)
 class Triple;
 typedef Triple Color;
@@ -14,62 +41,79 @@ typedef Triple Vector;
 class Triple
 {
     public:
+#if defined(TRIPLE_SSE2) && defined(RAY_SINGLE_PRECISION)
+        typedef __m128 Lane;
+#elif defined(TRIPLE_SSE2)
+        typedef __m128d Lane;
+#elif defined(TRIPLE_NEON) && defined(RAY_SINGLE_PRECISION)
+        typedef float32x4_t Lane;
+#elif defined(TRIPLE_NEON)
+        typedef float64x2_t Lane;
+#endif
+#ifdef TRIPLE_VECTORIZED
+        static unsigned const NUM_LANES = 4 * sizeof(Scalar) / sizeof(Lane);
+#endif
+
 // --- data members ------------------------------------------------------------
 
         // union to acces the same elements by
         // x, y, z, or r, g, b or data[index]
         union {
-            double data[3];
+            Scalar data[3];
             struct {
-                double x;
-                double y;
-                double z;
+                Scalar x;
+                Scalar y;
+                Scalar z;
             };
             struct {
-                double r;
-                double g;
-                double b;
+                Scalar r;
+                Scalar g;
+                Scalar b;
             };
+#ifdef TRIPLE_VECTORIZED
+            Scalar padded[4];           // x, y, z, 0
+            Lane lanes[NUM_LANES];
+#endif
         };
 
 // --- Constructors ------------------------------------------------------------
 
-        explicit Triple(double X = 0, double Y = 0, double Z = 0);
+        TRIPLE_CONSTEXPR explicit Triple(Scalar X = 0, Scalar Y = 0, Scalar Z = 0);
         explicit Triple(nlohmann::json const &node);    // json -> Triple
 
 // --- Operators ---------------------------------------------------------------
 
-        Triple operator+(Triple const &t) const;// add two triples
-        Triple operator+(double f) const;       // add a value to each member
-                                                // of a triple
-        Triple operator-() const;               // negate
-        Triple operator-(Triple const &t) const;// subtract two triples
-        Triple operator-(double f) const;       // subtract a value from each
-                                                // member
+        TRIPLE_CONSTEXPR Triple operator+(Triple const &t) const;// add two triples
+        TRIPLE_CONSTEXPR Triple operator+(Scalar f) const;       // add a value to each member
+                                                                 // of a triple
+        TRIPLE_CONSTEXPR Triple operator-() const;               // negate
+        TRIPLE_CONSTEXPR Triple operator-(Triple const &t) const;// subtract two triples
+        TRIPLE_CONSTEXPR Triple operator-(Scalar f) const;       // subtract a value from each
+                                                                 // member
 
-        Triple operator*(Triple const &t) const;// memberwise multiplication
-        Triple operator*(double f) const;       // multiply each member with a
-                                                // value
-        Triple operator/(double f) const;       // divide each member by a value
+        TRIPLE_CONSTEXPR Triple operator*(Triple const &t) const;// memberwise multiplication
+        TRIPLE_CONSTEXPR Triple operator*(Scalar f) const;       // multiply each member with a
+                                                                 // value
+        TRIPLE_CONSTEXPR Triple operator/(Scalar f) const;       // divide each member by a value
 
 // --- Compound operators ------------------------------------------------------
 
-        Triple &operator+=(Triple const &t);
-        Triple &operator+=(double f);
+        TRIPLE_CONSTEXPR Triple &operator+=(Triple const &t);
+        TRIPLE_CONSTEXPR Triple &operator+=(Scalar f);
 
-        Triple &operator-=(Triple const &t);
-        Triple &operator-=(double f);
+        TRIPLE_CONSTEXPR Triple &operator-=(Triple const &t);
+        TRIPLE_CONSTEXPR Triple &operator-=(Scalar f);
 
-        Triple &operator*=(double f);
-        Triple &operator/=(double f);
+        TRIPLE_CONSTEXPR Triple &operator*=(Scalar f);
+        TRIPLE_CONSTEXPR Triple &operator/=(Scalar f);
 
 // --- Vector Operators --------------------------------------------------------
 
-        double dot(Triple const &t) const;      // dot product
-        Triple cross(Triple const &t) const;    // cross product
+        TRIPLE_CONSTEXPR Scalar dot(Triple const &t) const;      // dot product
+        TRIPLE_CONSTEXPR Triple cross(Triple const &t) const;    // cross product
 
-        double length() const;
-        double length_2() const;                // length squared
+        Scalar length() const;
+        TRIPLE_CONSTEXPR Scalar length_2() const;                // length squared
 
         // NOTE: normalized return a COPY, normalize does NOT
         Triple normalized() const;              // normalized COPY
@@ -77,27 +121,468 @@ class Triple
 
 // --- Color functions ---------------------------------------------------------
 
-        void set(double f);                     // set all values to f
-        void set(double f, double maxValue);    // set all values to f / maxVal
-        void set(double red, double green, double blue);
-        void set(double red, double green, double blue, double maxValue);
+        TRIPLE_CONSTEXPR void set(Scalar f);                     // set all values to f
+        TRIPLE_CONSTEXPR void set(Scalar f, Scalar maxValue);    // set all values to f / maxVal
+        TRIPLE_CONSTEXPR void set(Scalar red, Scalar green, Scalar blue);
+        TRIPLE_CONSTEXPR void set(Scalar red, Scalar green, Scalar blue, Scalar maxValue);
+
+        Triple &clamp(Scalar maxValue = 1.0);      // clamp: fmin(val, maxValue)
 
-        Triple &clamp(double maxValue = 1.0);      // clamp: fmin(val, maxValue)
+#ifdef TRIPLE_VECTORIZED
+    private:
+        struct NoInit {};
+        explicit Triple(NoInit);
 
+        static Lane add(Lane lhs, Lane rhs);
+        static Lane sub(Lane lhs, Lane rhs);
+        static Lane mul(Lane lhs, Lane rhs);
+        static Lane neg(Lane lane);
+        static Lane splat(Scalar f);
+#endif
 };
 
 // --- Free Operators ----------------------------------------------------------
 
-Triple operator+(double f, Triple const &t);
-Triple operator-(double f, Triple const &t);
-Triple operator*(double f, Triple const &t);
+TRIPLE_CONSTEXPR Triple operator+(Scalar f, Triple const &t);
+TRIPLE_CONSTEXPR Triple operator-(Scalar f, Triple const &t);
+TRIPLE_CONSTEXPR Triple operator*(Scalar f, Triple const &t);
 
 // reflect incident in normal
-Triple reflect(Triple const &incident, Triple const &normal);
+TRIPLE_CONSTEXPR Triple reflect(Triple const &incident, Triple const &normal);
 
 // --- IO Operators ------------------------------------------------------------
 
 std::istream &operator>>(std::istream &is, Triple &t);
 std::ostream &operator<<(std::ostream &os, Triple const &t);
 
+// =============================================================================
+// -- Inline definitions -------------------------------------------------------
+// =============================================================================
+
+#ifdef TRIPLE_VECTORIZED
+
+// --- Vector backing ----------------------------------------------------------
+
+inline Triple::Triple(NoInit)
+{}
+
+#if defined(TRIPLE_SSE2) && defined(RAY_SINGLE_PRECISION)
+
+inline Triple::Lane Triple::add(Lane lhs, Lane rhs)
+{
+    return _mm_add_ps(lhs, rhs);
+}
+
+inline Triple::Lane Triple::sub(Lane lhs, Lane rhs)
+{
+    return _mm_sub_ps(lhs, rhs);
+}
+
+inline Triple::Lane Triple::mul(Lane lhs, Lane rhs)
+{
+    return _mm_mul_ps(lhs, rhs);
+}
+
+inline Triple::Lane Triple::neg(Lane lane)
+{
+    return _mm_xor_ps(lane, _mm_set1_ps(-0.0f));    // flip the sign bits
+}
+
+inline Triple::Lane Triple::splat(Scalar f)
+{
+    return _mm_set1_ps(f);
+}
+
+#elif defined(TRIPLE_SSE2)
+
+inline Triple::Lane Triple::add(Lane lhs, Lane rhs)
+{
+    return _mm_add_pd(lhs, rhs);
+}
+
+inline Triple::Lane Triple::sub(Lane lhs, Lane rhs)
+{
+    return _mm_sub_pd(lhs, rhs);
+}
+
+inline Triple::Lane Triple::mul(Lane lhs, Lane rhs)
+{
+    return _mm_mul_pd(lhs, rhs);
+}
+
+inline Triple::Lane Triple::neg(Lane lane)
+{
+    return _mm_xor_pd(lane, _mm_set1_pd(-0.0));     // flip the sign bits
+}
+
+inline Triple::Lane Triple::splat(Scalar f)
+{
+    return _mm_set1_pd(f);
+}
+
+#elif defined(RAY_SINGLE_PRECISION)     // TRIPLE_NEON
+
+inline Triple::Lane Triple::add(Lane lhs, Lane rhs)
+{
+    return vaddq_f32(lhs, rhs);
+}
+
+inline Triple::Lane Triple::sub(Lane lhs, Lane rhs)
+{
+    return vsubq_f32(lhs, rhs);
+}
+
+inline Triple::Lane Triple::mul(Lane lhs, Lane rhs)
+{
+    return vmulq_f32(lhs, rhs);
+}
+
+inline Triple::Lane Triple::neg(Lane lane)
+{
+    return vnegq_f32(lane);
+}
+
+inline Triple::Lane Triple::splat(Scalar f)
+{
+    return vdupq_n_f32(f);
+}
+
+#else   // TRIPLE_NEON
+
+inline Triple::Lane Triple::add(Lane lhs, Lane rhs)
+{
+    return vaddq_f64(lhs, rhs);
+}
+
+inline Triple::Lane Triple::sub(Lane lhs, Lane rhs)
+{
+    return vsubq_f64(lhs, rhs);
+}
+
+inline Triple::Lane Triple::mul(Lane lhs, Lane rhs)
+{
+    return vmulq_f64(lhs, rhs);
+}
+
+inline Triple::Lane Triple::neg(Lane lane)
+{
+    return vnegq_f64(lane);
+}
+
+inline Triple::Lane Triple::splat(Scalar f)
+{
+    return vdupq_n_f64(f);
+}
+
+#endif
+
+// --- Constructors ------------------------------------------------------------
+
+inline Triple::Triple(Scalar X, Scalar Y, Scalar Z)
+{
+    padded[0] = X;
+    padded[1] = Y;
+    padded[2] = Z;
+    padded[3] = 0;      // the padding element stays finite
+}
+
+// --- Operators ---------------------------------------------------------------
+
+inline Triple Triple::operator+(Triple const &t) const
+{
+    Triple result{NoInit()};
+    for (unsigned idx = 0; idx != NUM_LANES; ++idx)
+        result.lanes[idx] = add(lanes[idx], t.lanes[idx]);
+    return result;
+}
+
+inline Triple Triple::operator+(Scalar f) const
+{
+    Lane ff = splat(f);
+    Triple result{NoInit()};
+    for (unsigned idx = 0; idx != NUM_LANES; ++idx)
+        result.lanes[idx] = add(lanes[idx], ff);
+    return result;
+}
+
+inline Triple Triple::operator-() const
+{
+    Triple result{NoInit()};
+    for (unsigned idx = 0; idx != NUM_LANES; ++idx)
+        result.lanes[idx] = neg(lanes[idx]);
+    return result;
+}
+
+inline Triple Triple::operator-(Triple const &t) const
+{
+    Triple result{NoInit()};
+    for (unsigned idx = 0; idx != NUM_LANES; ++idx)
+        result.lanes[idx] = sub(lanes[idx], t.lanes[idx]);
+    return result;
+}
+
+inline Triple Triple::operator-(Scalar f) const
+{
+    Lane ff = splat(f);
+    Triple result{NoInit()};
+    for (unsigned idx = 0; idx != NUM_LANES; ++idx)
+        result.lanes[idx] = sub(lanes[idx], ff);
+    return result;
+}
+
+inline Triple Triple::operator*(Triple const &t) const
+{
+    Triple result{NoInit()};
+    for (unsigned idx = 0; idx != NUM_LANES; ++idx)
+        result.lanes[idx] = mul(lanes[idx], t.lanes[idx]);
+    return result;
+}
+
+inline Triple Triple::operator*(Scalar f) const
+{
+    Lane ff = splat(f);
+    Triple result{NoInit()};
+    for (unsigned idx = 0; idx != NUM_LANES; ++idx)
+        result.lanes[idx] = mul(lanes[idx], ff);
+    return result;
+}
+
+inline Triple Triple::operator/(Scalar f) const
+{
+    return (*this) * (1 / f);
+}
+
+// --- Compound operators ------------------------------------------------------
+
+inline Triple &Triple::operator+=(Triple const &t)
+{
+    return *this = *this + t;
+}
+
+inline Triple &Triple::operator+=(Scalar f)
+{
+    return *this = *this + f;
+}
+
+inline Triple &Triple::operator-=(Triple const &t)
+{
+    return *this = *this - t;
+}
+
+inline Triple &Triple::operator-=(Scalar f)
+{
+    return *this = *this - f;
+}
+
+inline Triple &Triple::operator*=(Scalar f)
+{
+    return *this = *this * f;
+}
+
+inline Triple &Triple::operator/=(Scalar f)
+{
+    return *this = *this / f;
+}
+
+#else   // scalar
+
+// --- Constructors ------------------------------------------------------------
+
+constexpr Triple::Triple(Scalar X, Scalar Y, Scalar Z)
+:
+    x(X),
+    y(Y),
+    z(Z)
+{}
+
+// --- Operators ---------------------------------------------------------------
+
+constexpr Triple Triple::operator+(Triple const &t) const
+{
+    return Triple(x + t.x, y + t.y, z + t.z);
+}
+
+constexpr Triple Triple::operator+(Scalar f) const
+{
+    return Triple(x + f, y + f, z + f);
+}
+
+constexpr Triple Triple::operator-() const
+{
+    return Triple(-x, -y, -z);
+}
+
+constexpr Triple Triple::operator-(Triple const &t) const
+{
+    return Triple(x - t.x, y - t.y, z - t.z);
+}
+
+constexpr Triple Triple::operator-(Scalar f) const
+{
+    return Triple(x - f, y - f, z - f);
+}
+
+constexpr Triple Triple::operator*(Triple const &t) const
+{
+    return Triple(x * t.x, y * t.y, z * t.z);
+}
+
+constexpr Triple Triple::operator*(Scalar f) const
+{
+    return Triple(x * f, y * f, z * f);
+}
+
+constexpr Triple Triple::operator/(Scalar f) const
+{
+    Scalar invf = 1 / f;
+    return Triple(x * invf, y * invf, z * invf);
+}
+
+// --- Compound operators ------------------------------------------------------
+
+constexpr Triple &Triple::operator+=(Triple const &t)
+{
+    x += t.x;
+    y += t.y;
+    z += t.z;
+    return *this;
+}
+
+constexpr Triple &Triple::operator+=(Scalar f)
+{
+    x += f;
+    y += f;
+    z += f;
+    return *this;
+}
+
+constexpr Triple &Triple::operator-=(Triple const &t)
+{
+    x -= t.x;
+    y -= t.y;
+    z -= t.z;
+    return *this;
+}
+
+constexpr Triple &Triple::operator-=(Scalar f)
+{
+    x -= f;
+    y -= f;
+    z -= f;
+    return *this;
+}
+
+constexpr Triple &Triple::operator*=(Scalar f)
+{
+    x *= f;
+    y *= f;
+    z *= f;
+    return *this;
+}
+
+constexpr Triple &Triple::operator/=(Scalar f)
+{
+    Scalar invf = 1 / f;
+    x *= invf;
+    y *= invf;
+    z *= invf;
+    return *this;
+}
+
+#endif
+
+// --- Vector Operators --------------------------------------------------------
+
+TRIPLE_CONSTEXPR Scalar Triple::dot(Triple const &t) const
+{
+    return x * t.x + y * t.y + z * t.z;
+}
+
+TRIPLE_CONSTEXPR Triple Triple::cross(Triple const &t) const
+{
+    return Triple(y*t.z - z*t.y,
+                  z*t.x - x*t.z,
+                  x*t.y - y*t.x);
+}
+
+inline Scalar Triple::length() const
+{
+    return std::sqrt(length_2());
+}
+
+TRIPLE_CONSTEXPR Scalar Triple::length_2() const
+{
+    return x * x + y * y + z * z;
+}
+
+inline Triple Triple::normalized() const
+{
+    return (*this) / length();
+}
+
+inline void Triple::normalize()
+{
+    Scalar len = length();
+    Scalar invlen = 1 / len;
+    x *= invlen;
+    y *= invlen;
+    z *= invlen;
+}
+
+// --- Color functions ---------------------------------------------------------
+
+TRIPLE_CONSTEXPR void Triple::set(Scalar f)
+{
+    r = f;
+    g = f;
+    b = f;
+}
+
+TRIPLE_CONSTEXPR void Triple::set(Scalar f, Scalar maxValue)
+{
+    set(f / maxValue);
+}
+
+TRIPLE_CONSTEXPR void Triple::set(Scalar red, Scalar green, Scalar blue)
+{
+    r = red;
+    g = green;
+    b = blue;
+}
+
+TRIPLE_CONSTEXPR void Triple::set(Scalar red, Scalar green, Scalar blue, Scalar maxValue)
+{
+    set(red / maxValue, green / maxValue, blue / maxValue);
+}
+
+inline Triple &Triple::clamp(Scalar maxValue)
+{
+    r = std::fmin(r, maxValue);
+    g = std::fmin(g, maxValue);
+    b = std::fmin(b, maxValue);
+    return *this;
+}
+
+// --- Free Operators ----------------------------------------------------------
+
+TRIPLE_CONSTEXPR Triple operator+(Scalar f, Triple const &t)
+{
+    return Triple(f + t.x, f + t.y, f + t.z);
+}
+
+TRIPLE_CONSTEXPR Triple operator-(Scalar f, Triple const &t)
+{
+    return Triple(f - t.x, f - t.y, f - t.z);
+}
+
+TRIPLE_CONSTEXPR Triple operator*(Scalar f, Triple const &t)
+{
+    return Triple(f * t.x, f * t.y, f * t.z);
+}
+
+TRIPLE_CONSTEXPR Triple reflect(Triple const &incident, Triple const &normal)
+{
+    return incident - 2.0 * normal.dot(incident) * normal;
+}
+
 #endif
@@ -0,0 +1,232 @@
+#include "wavefront.h"
+
+#include "image.h"
+#include "scene.h"
+
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+    unsigned const NONE = numeric_limits<unsigned>::max();
+}
+
+Wavefront::PathRay::PathRay(Ray const &ray, RayDifferential const &diff,
+                            unsigned depth, bool inside)
+:
+    ray(ray),
+    diff(diff),
+    depth(depth),
+    inside(inside),
+    color(),
+    reflected(NONE),
+    refracted(NONE),
+    reflectedWeight(0),
+    refractedWeight(0)
+{}
+
+Wavefront::Wavefront(Scene const &scene)
+:
+    d_scene(scene)
+{}
+
+void Wavefront::render(Image &img, vector<Pixel> const &pixels,
+                       unsigned ssr) const
+{
+    // Stage 0: all primary rays of the pixels
+    vector<Queue> stages(1);
+    for (Pixel const &pixel : pixels)
+        addSamples(d_scene.screenX(pixel.x), d_scene.screenY(pixel.y), 0.25,
+                   ssr, stages[0]);
+
+    // Process the stages until no more rays are spawned
+    while (!stages.back().empty())
+    {
+        stages.emplace_back();
+        processStage(stages[stages.size() - 2], stages.back());
+    }
+
+    // Gather the colors of the secondary rays, deepest stage first
+    for (unsigned stage = stages.size() - 1; stage-- != 0; )
+        gather(stages[stage], stages[stage + 1]);
+
+    Queue::const_iterator sample = stages[0].begin();
+    for (Pixel const &pixel : pixels)
+    {
+        Color col = combine(sample, ssr);
+        col.clamp();
+        img(pixel.x, pixel.y) = col;
+    }
+}
+
+// --- Private -----------------------------------------------------------------
+
+void Wavefront::processStage(Queue &stage, Queue &next) const
+{
+    Scene const &scene = d_scene;
+
+    // Intersect all rays of the stage
+    vector<HitRecord> hits(stage.size());
+    for (unsigned idx = 0; idx != stage.size(); ++idx)
+    {
+        STAT_ADD(levelSum, scene.recursionDepth - stage[idx].depth);
+        STAT_MAX(maxLevel, scene.recursionDepth - stage[idx].depth);
+        hits[idx] = scene.castRay(stage[idx].ray);
+    }
+
+    // Shade the hits. Rays which miss keep the black background color.
+    vector<ShadowRay> shadowRays;
+    for (unsigned idx = 0; idx != stage.size(); ++idx)
+    {
+        HitRecord const &record = hits[idx];
+        if (!record.isHit())
+            continue;
+
+        PathRay &path = stage[idx];
+        Ray const &ray = path.ray;
+        Scalar t = record.t;
+
+        Object &obj = *scene.objects[record.prim];
+        Material const &material = obj.material;
+        Point hit = ray.at(t);
+        Vector V = -ray.D;
+
+        Vector const &N = record.N;
+        Vector shadingN;
+        if (N.dot(V) >= 0.0)
+            shadingN = N;
+        else
+            shadingN = -N;
+
+        Vector dPdx;
+        Vector dPdy;
+        path.diff.transfer(ray.D, t, N, dPdx, dPdy);
+
+        Color matColor = scene.materialColor(obj, record, hit, dPdx, dPdy);
+        Scalar offset = scene.primitives.offset(record.prim, hit, scene.epsilon);
+
+        path.color = material.ka * matColor;
+
+        // The light is added directly, or once its shadow ray turns out to
+        // be unoccluded.
+        for (auto const &light : scene.lights)
+        {
+            Color diffuse;
+            Color specular;
+            scene.lightTerms(*light, material, matColor, hit, shadingN, V,
+                             diffuse, specular);
+
+            if (scene.renderShadows)
+            {
+                Point shadowOrigin = hit + offset * shadingN;
+                Vector toLight = light->position - shadowOrigin;
+                Ray shadowRay(shadowOrigin, toLight.normalized());
+                shadowRays.push_back(ShadowRay{shadowRay, toLight.length(), idx,
+                                               diffuse, specular});
+            }
+            else
+            {
+                path.color += diffuse;
+                path.color += specular;
+            }
+        }
+
+        if (path.depth > 0 && material.isTransparent)
+        {
+            Ray reflectRay(hit + offset * shadingN, reflect(ray.D, shadingN));
+
+            Vector T;
+            Scalar kr;
+            Scalar kt;
+            scene.refraction(ray.D, shadingN, material, path.inside, T, kr, kt);
+
+            Ray refractRay(hit - offset * shadingN, T.normalized());
+
+            Scalar eta = path.inside ? material.nt : 1.0 / material.nt;
+
+            STAT_ADD(reflected, 1);
+            STAT_ADD(refracted, 1);
+
+            path.reflected = next.size();
+            path.reflectedWeight = kr;
+            next.push_back(PathRay(reflectRay,
+                                   path.diff.reflected(shadingN, dPdx, dPdy),
+                                   path.depth - 1, path.inside));
+
+            path.refracted = next.size();
+            path.refractedWeight = kt;
+            next.push_back(PathRay(refractRay,
+                                   path.diff.refracted(eta, dPdx, dPdy),
+                                   path.depth - 1, not path.inside));
+        }
+        else if (path.depth > 0 && material.ks > 0.0)
+        {
+            Ray reflectRay(hit + offset * shadingN, reflect(ray.D, shadingN));
+
+            STAT_ADD(reflected, 1);
+
+            path.reflected = next.size();
+            path.reflectedWeight = material.ks;
+            next.push_back(PathRay(reflectRay,
+                                   path.diff.reflected(shadingN, dPdx, dPdy),
+                                   path.depth - 1, path.inside));
+        }
+    }
+
+    STAT_ADD(shadow, shadowRays.size());
+
+    // Test the shadow rays. They were added per ray in the order of the
+    // lights, so the light is accumulated in the same order as by trace.
+    for (ShadowRay const &shadow : shadowRays)
+    {
+        if (scene.occluded(shadow.ray, shadow.maxT))
+            continue;
+
+        stage[shadow.owner].color += shadow.diffuse;
+        stage[shadow.owner].color += shadow.specular;
+    }
+}
+
+void Wavefront::gather(Queue &stage, Queue const &next) const
+{
+    for (PathRay &path : stage)
+    {
+        if (path.refracted != NONE)
+            path.color += path.reflectedWeight * next[path.reflected].color
+                        + path.refractedWeight * next[path.refracted].color;
+        else if (path.reflected != NONE)
+            path.color += path.reflectedWeight * next[path.reflected].color;
+    }
+}
+
+void Wavefront::addSamples(Scalar x, Scalar y, Scalar shift, unsigned ssr,
+                           Queue &queue) const
+{
+    if (ssr != 1)
+    {
+        addSamples(x - shift, y + shift, shift/2.0, ssr-1, queue);
+        addSamples(x + shift, y + shift, shift/2.0, ssr-1, queue);
+        addSamples(x + shift, y - shift, shift/2.0, ssr-1, queue);
+        addSamples(x - shift, y - shift, shift/2.0, ssr-1, queue);
+        return;
+    }
+
+    Ray ray(d_scene.camera.eye(), d_scene.camera.direction(x, y));
+    STAT_ADD(primary, 1);
+    queue.push_back(PathRay(ray, d_scene.cameraDifferential(x, y, 4 * shift, ray.D),
+                            d_scene.recursionDepth, false));
+}
+
+Color Wavefront::combine(Queue::const_iterator &sample, unsigned ssr) const
+{
+    if (ssr == 1)
+        return (sample++)->color;
+
+    Color col = combine(sample, ssr - 1);
+    col += combine(sample, ssr - 1);
+    col += combine(sample, ssr - 1);
+    col += combine(sample, ssr - 1);
+    col /= 4;
+    return col;
+}
@@ -0,0 +1,90 @@
+#ifndef WAVEFRONT_H_
+#define WAVEFRONT_H_
+
+#include "ray.h"
+#include "raydifferential.h"
+#include "triple.h"
+
+#include <vector>
+
+class Image;
+class Scene;
+
+// Iterative alternative to the recursive Scene::trace. All primary rays of
+// a set of pixels (usually a tile) are generated into a queue, which is then
+// processed stage by stage: the rays of a stage are intersected as one
+// batch, the hits are shaded, and the reflected and refracted rays they
+// spawn form the queue of the next stage. Shadow rays are collected per
+// stage and tested as a batch too.
+//
+// Every ray records the weights (kr and kt, or ks) with which the rays it
+// spawned contribute to its color. Once the last stage is done, the colors
+// are gathered back to the primary rays in reverse stage order, with the
+// same operations as Scene::trace, so both give the same images.
+class Wavefront
+{
+    Scene const &d_scene;
+
+    public:
+        struct Pixel
+        {
+            unsigned x;
+            unsigned y;
+        };
+
+        explicit Wavefront(Scene const &scene);
+
+        // render the given pixels into img, with supersampling factor ssr
+        void render(Image &img, std::vector<Pixel> const &pixels,
+                    unsigned ssr) const;
+
+    private:
+        // a ray in one of the stage queues
+        struct PathRay
+        {
+            Ray ray;
+            RayDifferential diff;
+            unsigned depth;     // remaining number of bounces
+            bool inside;
+
+            // own shading, plus the contribution of its children once
+            // gathered
+            Color color;
+
+            // spawned rays (indices into the next stage) and their weights
+            unsigned reflected;
+            unsigned refracted;
+            Scalar reflectedWeight;
+            Scalar refractedWeight;
+
+            PathRay(Ray const &ray, RayDifferential const &diff,
+                    unsigned depth, bool inside);
+        };
+
+        // a shadow ray, with the light its owner receives if it is unoccluded
+        struct ShadowRay
+        {
+            Ray ray;
+            Scalar maxT;
+            unsigned owner;     // index in the current stage
+            Color diffuse;
+            Color specular;
+        };
+
+        typedef std::vector<PathRay> Queue;
+
+        // intersect and shade the rays of a stage, spawning the next stage
+        void processStage(Queue &stage, Queue &next) const;
+
+        // add the colors of the next stage to the rays that spawned them
+        void gather(Queue &stage, Queue const &next) const;
+
+        // primary ray positions of a pixel, in the order of Scene::supersample
+        void addSamples(Scalar x, Scalar y, Scalar shift, unsigned ssr,
+                        Queue &queue) const;
+
+        // average the colors of the samples of a pixel as Scene::supersample
+        Color combine(Queue::const_iterator &sample, unsigned ssr) const;
+};
+
+#endif
@@ -0,0 +1,29 @@
+# Renders SCENE with RAY in one process and with worker processes (small
+# tiles, so that many tile edges cross the image) and fails unless both
+# images are identical. Run by ctest, see CMakeLists.txt.
+
+set(single ${CMAKE_CURRENT_BINARY_DIR}/workers_single.png)
+set(workers ${CMAKE_CURRENT_BINARY_DIR}/workers_coordinated.png)
+
+foreach (image ${single} ${workers})
+    file(REMOVE ${image})
+endforeach()
+
+execute_process(COMMAND ${RAY} ${SCENE} ${single}
+                RESULT_VARIABLE status OUTPUT_QUIET)
+if (NOT status EQUAL 0)
+    message(FATAL_ERROR "Rendering ${SCENE} failed (${status}).")
+endif()
+
+execute_process(COMMAND ${RAY} --workers 3 --worker-tile-size 37 ${SCENE} ${workers}
+                RESULT_VARIABLE status OUTPUT_QUIET)
+if (NOT status EQUAL 0)
+    message(FATAL_ERROR "Rendering ${SCENE} with workers failed (${status}).")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${single} ${workers}
+                RESULT_VARIABLE status)
+if (NOT status EQUAL 0)
+    message(FATAL_ERROR "The image rendered by workers differs from the "
+                        "single process render.")
+endif()